@@ -0,0 +1,143 @@
+#include "AllocationBitmap.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+constexpr size_t npos = AllocationBitmap::npos;
+
+// State of the run of clear bits being followed across words
+struct Run {
+    size_t start = 0;
+    size_t length = 0;
+};
+
+// Follows the run through one word whose bit 0 stands for position base
+// Returns the start of the first run of count clear bits, or npos to keep going
+inline size_t scan_word(uint64_t word, size_t base, size_t count, Run& run) {
+    if (word == 0) {
+        if (run.length == 0) run.start = base;
+        run.length += 64;
+        return run.length >= count ? run.start : npos;
+    }
+
+    // Clear bits at the bottom continue the run from the previous word
+    size_t low = __builtin_ctzll(word);
+    if (run.length == 0) run.start = base;
+    if (run.length + low >= count) return run.start;
+
+    // Runs wholly inside the word: bit i of starts survives when bits i..i+count-1 are all clear
+    if (count < 64) {
+        uint64_t starts = ~word;
+        for (size_t covered = 1; covered < count;) {
+            size_t step = covered < count - covered ? covered : count - covered;
+            starts &= starts >> step;
+            covered += step;
+        }
+        if (starts) return base + __builtin_ctzll(starts);
+    }
+
+    // Clear bits at the top start a run into the next word
+    size_t high = __builtin_clzll(word);
+    run.start = base + 64 - high;
+    run.length = high;
+    return npos;
+}
+
+size_t scan_scalar(const uint64_t* bits, size_t words, size_t count) {
+    Run run;
+    for (size_t i = 0; i < words; ++i) {
+        size_t found = scan_word(bits[i], i * 64, count, run);
+        if (found != npos) return found;
+    }
+    return npos;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// Tests 256 bits at a time, so fully allocated and fully free stretches cost one load per 256 words
+__attribute__((target("avx2")))
+size_t scan_avx2(const uint64_t* bits, size_t words, size_t count) {
+    const __m256i ones = _mm256_set1_epi64x(-1);
+    Run run;
+    size_t i = 0;
+    for (; i + 4 <= words; i += 4) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bits + i));
+        if (_mm256_testc_si256(chunk, ones)) {
+            run.length = 0;
+            continue;
+        }
+        if (_mm256_testz_si256(chunk, chunk)) {
+            if (run.length == 0) run.start = i * 64;
+            run.length += 256;
+            if (run.length >= count) return run.start;
+            continue;
+        }
+        for (size_t j = i; j < i + 4; ++j) {
+            size_t found = scan_word(bits[j], j * 64, count, run);
+            if (found != npos) return found;
+        }
+    }
+    for (; i < words; ++i) {
+        size_t found = scan_word(bits[i], i * 64, count, run);
+        if (found != npos) return found;
+    }
+    return npos;
+}
+#endif
+
+#if defined(__aarch64__)
+// Same as scan_avx2 with two 128-bit loads per 256 words
+size_t scan_neon(const uint64_t* bits, size_t words, size_t count) {
+    Run run;
+    size_t i = 0;
+    for (; i + 4 <= words; i += 4) {
+        uint32x4_t low = vreinterpretq_u32_u64(vld1q_u64(bits + i));
+        uint32x4_t high = vreinterpretq_u32_u64(vld1q_u64(bits + i + 2));
+        if (vminvq_u32(vandq_u32(low, high)) == UINT32_MAX) {
+            run.length = 0;
+            continue;
+        }
+        if (vmaxvq_u32(vorrq_u32(low, high)) == 0) {
+            if (run.length == 0) run.start = i * 64;
+            run.length += 256;
+            if (run.length >= count) return run.start;
+            continue;
+        }
+        for (size_t j = i; j < i + 4; ++j) {
+            size_t found = scan_word(bits[j], j * 64, count, run);
+            if (found != npos) return found;
+        }
+    }
+    for (; i < words; ++i) {
+        size_t found = scan_word(bits[i], i * 64, count, run);
+        if (found != npos) return found;
+    }
+    return npos;
+}
+#endif
+
+using RunScanner = size_t (*)(const uint64_t*, size_t, size_t);
+
+// Widest kernel the running CPU supports
+RunScanner pick_scanner() {
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2")) return scan_avx2;
+#elif defined(__aarch64__)
+    return scan_neon;
+#endif
+    return scan_scalar;
+}
+
+}  // namespace
+
+// Lowest position starting count clear bits, or npos
+// Bits past size() are never clear, so no run extends beyond the map
+size_t AllocationBitmap::findClearRun(size_t count) const {
+    static const RunScanner scanner = pick_scanner();
+    if (count == 0 || count > length) return npos;
+    return scanner(bits.data(), bits.size(), count);
+}
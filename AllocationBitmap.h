@@ -0,0 +1,80 @@
+#ifndef ALLOCATION_BITMAP_H
+#define ALLOCATION_BITMAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// One bit per word of the storage area, set while the word is allocated
+// MemoryManager updates it as blocks are carved and released, a 64-bit word of
+// the map at a time, so reading the map is a copy rather than a walk of the holes.
+// findClearRun() searches it for free space with SIMD kernels where the CPU has them.
+class AllocationBitmap {
+private:
+    std::vector<uint64_t> bits;
+    size_t length;  // Bits in use
+
+    // Calls apply(word, mask) on each 64-bit word overlapping [first, first + count)
+    template <typename Apply>
+    void for_range(size_t first, size_t count, Apply apply) {
+        if (count == 0) return;
+        size_t last = first + count - 1;
+        size_t first_word = first / 64;
+        size_t last_word = last / 64;
+        uint64_t head = ~0ull << (first % 64);
+        uint64_t tail = ~0ull >> (63 - last % 64);
+        if (first_word == last_word) {
+            apply(bits[first_word], head & tail);
+            return;
+        }
+        apply(bits[first_word], head);
+        for (size_t word = first_word + 1; word < last_word; ++word) apply(bits[word], ~0ull);
+        apply(bits[last_word], tail);
+    }
+
+public:
+    static constexpr size_t npos = SIZE_MAX;
+
+    AllocationBitmap() : length(0) {}
+
+    // Sizes the map to words bits, all set; bits past the end of the last word stay set
+    void reset(size_t words) {
+        length = words;
+        bits.assign((words + 63) / 64, ~0ull);
+    }
+
+    // Lengthens the map to words bits; the new bits are set
+    void extend(size_t words) {
+        bits.resize((words + 63) / 64, ~0ull);
+        length = words;
+    }
+
+    void setRange(size_t first, size_t count) {
+        for_range(first, count, [](uint64_t& word, uint64_t mask) { word |= mask; });
+    }
+
+    void clearRange(size_t first, size_t count) {
+        for_range(first, count, [](uint64_t& word, uint64_t mask) { word &= ~mask; });
+    }
+
+    bool test(size_t index) const { return (bits[index / 64] >> (index % 64)) & 1; }
+    size_t size() const { return length; }
+    size_t byteCount() const { return (length + 7) / 8; }
+    const uint64_t* data() const { return bits.data(); }
+    size_t findClearRun(size_t count) const;
+
+    // Writes byteCount() bytes, bit i of byte b standing for word 8 * b + i
+    // Bits past size() are zero
+    void copyTo(uint8_t* out) const {
+        size_t bytes = byteCount();
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        std::memcpy(out, bits.data(), bytes);
+#else
+        for (size_t i = 0; i < bytes; ++i) out[i] = static_cast<uint8_t>(bits[i / 8] >> (8 * (i % 8)));
+#endif
+        if (length % 8) out[bytes - 1] &= static_cast<uint8_t>((1u << (length % 8)) - 1);
+    }
+};
+
+#endif
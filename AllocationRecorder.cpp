@@ -0,0 +1,209 @@
+#include "AllocationRecorder.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+std::atomic<uint64_t> next_recorder_id{1};
+
+constexpr char MAGIC[8] = {'M', 'M', 'T', 'R', 'A', 'C', 'E', '1'};
+constexpr auto FLUSH_INTERVAL = std::chrono::milliseconds(10);
+
+// Rings the calling thread writes to, one per recorder it has recorded into
+struct RingSlots {
+    std::vector<std::pair<uint64_t, std::shared_ptr<AllocationRecorder::Ring>>> entries;
+    ~RingSlots() {
+        for (auto& entry : entries) {
+            entry.second->orphaned.store(true, std::memory_order_release);
+        }
+    }
+};
+
+thread_local RingSlots ring_slots;
+
+uint64_t zigzag(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+int64_t unzigzag(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+// Reads one varint; false at end of file or on a truncated value
+bool get_varint(FILE* input, uint64_t& value) {
+    value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        int byte = std::fgetc(input);
+        if (byte == EOF) return false;
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+}  // namespace
+
+AllocationRecorder::AllocationRecorder(const char* path, unsigned wordSize, size_t ringRecords)
+    : instance_id(next_recorder_id.fetch_add(1, std::memory_order_relaxed)),
+      ring_records(std::max<size_t>(ringRecords, 2)), output(std::fopen(path, "wb")),
+      started(std::chrono::steady_clock::now()), next_thread(0), dropped(0), stopping(false) {
+    if (!output) return;
+    std::fwrite(MAGIC, 1, sizeof(MAGIC), output);
+    put_varint(wordSize);
+    std::fwrite(buffer.data(), 1, buffer.size(), output);
+    buffer.clear();
+    flusher = std::thread([this] { flush_loop(); });
+}
+
+// Stops the flusher, writes whatever the rings still hold and closes the file
+AllocationRecorder::~AllocationRecorder() {
+    if (!output) return;
+    {
+        std::lock_guard<std::mutex> guard(wake_lock);
+        stopping.store(true, std::memory_order_relaxed);
+    }
+    wake.notify_one();
+    flusher.join();
+    drain();
+    std::fclose(output);
+    for (auto& ring : rings) ring->retired.store(true, std::memory_order_release);
+}
+
+// The calling thread's ring, made and registered on first use
+AllocationRecorder::Ring* AllocationRecorder::local_ring() {
+    auto& entries = ring_slots.entries;
+    for (auto& entry : entries) {
+        if (entry.first == instance_id) return entry.second.get();
+    }
+
+    // Forget rings of recorders that have since stopped
+    entries.erase(std::remove_if(entries.begin(), entries.end(), [](const auto& entry) {
+        return entry.second->retired.load(std::memory_order_acquire);
+    }), entries.end());
+
+    auto ring = std::make_shared<Ring>();
+    ring->slots.resize(ring_records);
+    {
+        std::lock_guard<std::mutex> guard(rings_lock);
+        ring->thread = next_thread++;
+        rings.push_back(ring);
+    }
+    entries.emplace_back(instance_id, ring);
+    return ring.get();
+}
+
+// Appends to the calling thread's ring, dropping the record if the flusher has fallen behind
+void AllocationRecorder::push(uint64_t offset, uint64_t bytes, bool free) {
+    if (!output) return;
+    Ring* ring = local_ring();
+    size_t head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) == ring->slots.size()) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count();
+    ring->slots[head % ring->slots.size()] = {now, ring->thread, free, offset, bytes};
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+void AllocationRecorder::recordAllocate(uint64_t offset, uint64_t bytes) {
+    push(offset, bytes, false);
+}
+
+void AllocationRecorder::recordFree(uint64_t offset) {
+    push(offset, 0, true);
+}
+
+void AllocationRecorder::flush_loop() {
+    std::unique_lock<std::mutex> guard(wake_lock);
+    while (!stopping.load(std::memory_order_relaxed)) {
+        wake.wait_for(guard, FLUSH_INTERVAL);
+        guard.unlock();
+        drain();
+        guard.lock();
+    }
+}
+
+void AllocationRecorder::put_varint(uint64_t value) {
+    while (value >= 0x80) {
+        buffer.push_back(static_cast<uint8_t>(value) | 0x80);
+        value >>= 7;
+    }
+    buffer.push_back(static_cast<uint8_t>(value));
+}
+
+// Writes out every ring's pending records as one chunk per ring; rings of exited
+// threads are dropped once empty
+void AllocationRecorder::drain() {
+    std::vector<std::shared_ptr<Ring>> pending;
+    {
+        std::lock_guard<std::mutex> guard(rings_lock);
+        pending = rings;
+    }
+
+    for (auto& ring : pending) {
+        size_t tail = ring->tail.load(std::memory_order_relaxed);
+        size_t head = ring->head.load(std::memory_order_acquire);
+        if (head == tail) continue;
+
+        put_varint(ring->thread);
+        put_varint(head - tail);
+        uint64_t last_time = 0;
+        uint64_t last_offset = 0;
+        for (size_t i = tail; i != head; ++i) {
+            const Record& record = ring->slots[i % ring->slots.size()];
+            put_varint(((record.nanoseconds - last_time) << 1) | (record.free ? 1 : 0));
+            put_varint(zigzag(static_cast<int64_t>(record.offset - last_offset)));
+            if (!record.free) put_varint(record.bytes);
+            last_time = record.nanoseconds;
+            last_offset = record.offset;
+        }
+        ring->tail.store(head, std::memory_order_release);
+    }
+    if (!buffer.empty()) {
+        std::fwrite(buffer.data(), 1, buffer.size(), output);
+        std::fflush(output);
+        buffer.clear();
+    }
+
+    // An orphaned ring found empty after its last drain will never fill again
+    std::lock_guard<std::mutex> guard(rings_lock);
+    rings.erase(std::remove_if(rings.begin(), rings.end(), [](const std::shared_ptr<Ring>& ring) {
+        return ring->orphaned.load(std::memory_order_acquire) &&
+               ring->head.load(std::memory_order_acquire) == ring->tail.load(std::memory_order_relaxed);
+    }), rings.end());
+}
+
+bool AllocationRecorder::read(const char* path, std::vector<Record>& records, unsigned* wordSize) {
+    FILE* input = std::fopen(path, "rb");
+    if (!input) return false;
+
+    char magic[sizeof(MAGIC)];
+    uint64_t word_size;
+    bool valid = std::fread(magic, 1, sizeof(magic), input) == sizeof(magic) &&
+                 std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0 && get_varint(input, word_size);
+    if (valid && wordSize) *wordSize = static_cast<unsigned>(word_size);
+
+    uint64_t thread, count;
+    while (valid && get_varint(input, thread)) {
+        if (!get_varint(input, count)) {
+            valid = false;
+            break;
+        }
+        uint64_t time = 0, offset = 0;
+        for (uint64_t i = 0; i < count && valid; ++i) {
+            uint64_t tagged = 0, delta = 0, bytes = 0;
+            valid = get_varint(input, tagged) && get_varint(input, delta);
+            bool is_free = tagged & 1;
+            if (valid && !is_free) valid = get_varint(input, bytes);
+            if (!valid) break;
+            time += tagged >> 1;
+            offset += static_cast<uint64_t>(unzigzag(delta));
+            records.push_back({time, static_cast<uint32_t>(thread), is_free, offset, bytes});
+        }
+    }
+    std::fclose(input);
+    std::stable_sort(records.begin(), records.end(),
+                     [](const Record& a, const Record& b) { return a.nanoseconds < b.nanoseconds; });
+    return valid;
+}
@@ -0,0 +1,88 @@
+#ifndef ALLOCATION_RECORDER_H
+#define ALLOCATION_RECORDER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Records allocations and frees to a compact binary log at low overhead
+// Each thread appends to a ring of its own, so recording is a few stores and one
+// release store; a background thread drains the rings every few milliseconds and
+// writes them out. Records that find their ring full are dropped and counted.
+//
+// File format, all integers LEB128 varints:
+//   file   := "MMTRACE1" varint(wordSize) chunk*
+//   chunk  := varint(thread) varint(count) record{count}
+//   record := varint(timeDelta << 1 | isFree) varint(zigzag(offsetDelta)) [varint(bytes) unless isFree]
+// Times are nanoseconds since recording started and offsets bytes from the start of
+// the storage area; both are deltas from the previous record of the chunk, starting
+// from 0. A chunk holds records of one thread in order; chunks of different threads
+// interleave, so readers merge by time.
+class AllocationRecorder {
+public:
+    struct Record {
+        uint64_t nanoseconds;
+        uint32_t thread;
+        bool free;
+        uint64_t offset;
+        uint64_t bytes;  // Requested size; 0 for frees
+    };
+
+    // Single-producer, single-consumer ring of one thread's records
+    struct Ring {
+        std::vector<Record> slots;
+        std::atomic<size_t> head{0};   // Next slot the producer writes
+        std::atomic<size_t> tail{0};   // Next slot the consumer reads
+        std::atomic<bool> orphaned{false};  // Producing thread has exited
+        std::atomic<bool> retired{false};   // Recorder has stopped and dropped the ring
+        uint32_t thread = 0;
+    };
+
+private:
+    uint64_t instance_id;
+    size_t ring_records;
+    FILE* output;
+    std::chrono::steady_clock::time_point started;
+    std::mutex rings_lock;  // Guards rings; never taken on the recording path once a thread has its ring
+    std::vector<std::shared_ptr<Ring>> rings;
+    uint32_t next_thread;
+    std::atomic<size_t> dropped;
+    std::atomic<bool> stopping;
+    std::mutex wake_lock;
+    std::condition_variable wake;
+    std::thread flusher;
+    std::vector<uint8_t> buffer;  // Flusher only
+
+    Ring* local_ring();
+    void push(uint64_t offset, uint64_t bytes, bool free);
+    void flush_loop();
+    void drain();
+    void put_varint(uint64_t value);
+
+public:
+    static constexpr size_t DEFAULT_RING_RECORDS = 8192;
+
+    // Opens path and starts the flusher; isOpen() tells whether the file could be created
+    AllocationRecorder(const char* path, unsigned wordSize, size_t ringRecords = DEFAULT_RING_RECORDS);
+    ~AllocationRecorder();
+
+    AllocationRecorder(const AllocationRecorder&) = delete;
+    AllocationRecorder& operator=(const AllocationRecorder&) = delete;
+
+    bool isOpen() const { return output != nullptr; }
+    void recordAllocate(uint64_t offset, uint64_t bytes);
+    void recordFree(uint64_t offset);
+    size_t getDroppedCount() const { return dropped.load(std::memory_order_relaxed); }
+
+    // Decodes a log into records merged by time; false if it is not a complete log
+    static bool read(const char* path, std::vector<Record>& records, unsigned* wordSize = nullptr);
+};
+
+#endif
@@ -0,0 +1,68 @@
+#include "ArenaScope.h"
+
+// No memory is taken from the parent until the first allocation
+ArenaScope::ArenaScope(MemoryManager& manager, size_t chunkBytes)
+    : parent(manager), chunk_bytes(chunkBytes < 4 * LINK_BYTES ? 4 * LINK_BYTES : chunkBytes),
+      current(nullptr), cursor(nullptr), limit(nullptr), chunk_count(0) {}
+
+// Hands every chunk back to the parent
+ArenaScope::~ArenaScope() {
+    release_chunks(current);
+}
+
+// Rounds address up to a multiple of alignment, which is a power of two
+uint8_t* ArenaScope::align_up(uint8_t* address, size_t alignment) {
+    uintptr_t value = reinterpret_cast<uintptr_t>(address);
+    return reinterpret_cast<uint8_t*>((value + alignment - 1) & ~(uintptr_t(alignment) - 1));
+}
+
+// Frees chunk and every chunk before it with a single freeBatch(), which takes the
+// parent's lock once and merges the chunks back into the free space in one pass
+void ArenaScope::release_chunks(uint8_t* chunk) {
+    released.clear();
+    for (; chunk; chunk = previous_of(chunk)) released.push_back(chunk);
+    if (released.empty()) return;
+    parent.freeBatch(released.data(), released.size());
+    chunk_count -= released.size();
+}
+
+// Takes a new chunk from the parent, large enough for the request after alignment
+bool ArenaScope::grow(size_t sizeInBytes, size_t alignment) {
+    size_t needed = LINK_BYTES + alignment + sizeInBytes;
+    size_t bytes = needed > chunk_bytes ? needed : chunk_bytes;
+    uint8_t* chunk = static_cast<uint8_t*>(parent.allocate(bytes));
+    if (!chunk) return false;
+
+    set_previous(chunk, current);
+    current = chunk;
+    cursor = chunk + LINK_BYTES;
+    limit = chunk + bytes;
+    chunk_count++;
+    return true;
+}
+
+// Bumps the cursor past sizeInBytes, aligned to alignment (a power of two)
+// Only a full chunk goes back to the parent
+void* ArenaScope::allocate(size_t sizeInBytes, size_t alignment) {
+    if (sizeInBytes == 0 || alignment == 0 || (alignment & (alignment - 1))) return nullptr;
+
+    uint8_t* block = current ? align_up(cursor, alignment) : nullptr;
+    if (!block || block > limit || static_cast<size_t>(limit - block) < sizeInBytes) {
+        if (!grow(sizeInBytes, alignment)) return nullptr;
+        block = align_up(cursor, alignment);
+    }
+    cursor = block + sizeInBytes;
+    return block;
+}
+
+// Returns every chunk but the newest to the parent and rewinds the cursor to its start
+void ArenaScope::reset() {
+    if (!current) return;
+    release_chunks(previous_of(current));
+    set_previous(current, nullptr);
+    cursor = current + LINK_BYTES;
+}
+
+size_t ArenaScope::getChunkCount() const {
+    return chunk_count;
+}
@@ -0,0 +1,59 @@
+#ifndef ARENA_SCOPE_H
+#define ARENA_SCOPE_H
+
+#include "MemoryManager.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Bump-pointer scratch allocator layered on a MemoryManager
+// Memory is taken from the parent in chunks and handed out by advancing a
+// cursor, so allocate() neither splits regions nor touches the parent's state
+// until a chunk runs out. Individual blocks are never freed; reset() rewinds
+// the arena and leaving the scope gives every chunk back in one go.
+// Blocks must not be passed to the parent's free(). The scope must be
+// destroyed before its parent is shut down or reinitialized.
+class ArenaScope {
+private:
+    // Every chunk starts with a pointer to the chunk before it; chunks are linked newest
+    // first. The parent only aligns chunks to its word size, so the link is copied in and
+    // out rather than accessed in place.
+    static constexpr size_t LINK_BYTES = sizeof(void*);
+
+    MemoryManager& parent;
+    size_t chunk_bytes;
+    uint8_t* current;   // Chunk being bumped through, or nullptr
+    uint8_t* cursor;    // Next free byte of current
+    uint8_t* limit;     // End of current
+    size_t chunk_count;
+    std::vector<void*> released;  // Chunks handed to the parent's freeBatch(); reused across resets
+
+    static uint8_t* align_up(uint8_t* address, size_t alignment);
+    static uint8_t* previous_of(uint8_t* chunk) {
+        uint8_t* previous;
+        std::memcpy(&previous, chunk, LINK_BYTES);
+        return previous;
+    }
+    static void set_previous(uint8_t* chunk, uint8_t* previous) { std::memcpy(chunk, &previous, LINK_BYTES); }
+    bool grow(size_t sizeInBytes, size_t alignment);
+    void release_chunks(uint8_t* chunk);
+
+public:
+    static constexpr size_t DEFAULT_ALIGNMENT = alignof(std::max_align_t);
+
+    // chunkBytes: bytes requested from the parent for each chunk; larger
+    // requests get a chunk of their own size
+    explicit ArenaScope(MemoryManager& manager, size_t chunkBytes = 16384);
+    ~ArenaScope();
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+    void* allocate(size_t sizeInBytes, size_t alignment = DEFAULT_ALIGNMENT);
+    void free(void*) {}  // Blocks live until reset() or the end of the scope
+    void reset();        // Frees everything at once, keeping the newest chunk for reuse
+    size_t getChunkCount() const;
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef BASIC_MEMORY_MANAGER_H
+#define BASIC_MEMORY_MANAGER_H
+
+#include "MemoryManager.h"
+
+// Fit policies for BasicMemoryManager
+// A policy is any type with size_t select(size_t words, const FreeIndex& index)
+// returning the position of the chosen hole or HoleView::npos. Policies may keep
+// state between calls, as NextFitPolicy does.
+struct BestFitPolicy {
+    size_t select(size_t words, const FreeIndex& index) { return index.bestFit(words); }
+};
+
+struct WorstFitPolicy {
+    size_t select(size_t words, const FreeIndex& index) { return index.worstFit(words); }
+};
+
+struct FirstFitPolicy {
+    size_t select(size_t words, const FreeIndex& index) { return index.firstFit(words); }
+};
+
+struct NextFitPolicy {
+    size_t cursor = 0;  // Where the previous search stopped
+    size_t select(size_t words, const FreeIndex& index) { return index.nextFit(words, cursor); }
+};
+
+// MemoryManager with the fit policy and word size fixed at compile time
+// allocate() calls the policy directly and divides by a constant, so both
+// inline instead of going through a std::function. Configurations the policy
+// cannot drive directly (concurrent mode, backends other than Regions, deferred
+// frees, latency histograms) go through MemoryManager::allocate with the policy
+// wrapped as its selector, as does a request no hole fits, which may grow the
+// arena. Either way the statistics, trace hook and recorder see every request.
+// MemoryManager itself remains the runtime-polymorphic manager for callers
+// that need setAllocator().
+template <typename Strategy, unsigned WordSize>
+class BasicMemoryManager : public MemoryManager {
+    static_assert(WordSize > 0, "WordSize must be at least one byte");
+
+private:
+    Strategy policy;
+
+public:
+    explicit BasicMemoryManager(Strategy strategy = Strategy())
+        : MemoryManager(WordSize, HoleSelector([this](size_t words, const HoleView& holes) {
+              return policy.select(words, FreeIndex(nullptr, holes));
+          })),
+          policy(strategy) {}
+
+    void* allocate(size_t sizeInBytes) {
+        if (!uses_region_index()) return MemoryManager::allocate(sizeInBytes);
+        if (sizeInBytes == 0) return nullptr;
+
+        size_t words = (sizeInBytes + WordSize - 1) / WordSize;
+        size_t position = policy.select(words, free_index());
+        if (position == HoleView::npos) return MemoryManager::allocate(sizeInBytes);
+        return allocate_at(position, words, sizeInBytes);
+    }
+
+    // The strategy is part of the type
+    void setAllocator(std::function<int(int, void*)> allocator) = delete;
+    void setAllocator(HoleSelector allocator) = delete;
+
+    Strategy& getStrategy() { return policy; }
+};
+
+#endif
@@ -0,0 +1,307 @@
+#include "BoundaryTagHeap.h"
+
+BoundaryTagHeap::BoundaryTagHeap()
+    : base(nullptr), capacity(0), unit_size(1), tag_words(0), min_extent(0), sl_bits(0), level_bitmap(0),
+      free_blocks(0) {}
+
+// Lays a single free block over the whole storage area
+// Arenas too small to hold even one block are left with no blocks at all
+void BoundaryTagHeap::reset(uint8_t* storage, size_t capacityWords, unsigned wordSize, unsigned secondLevelBits) {
+    configure(storage, capacityWords, wordSize, secondLevelBits);
+    if (capacity > 0) {
+        write_tags(0, capacity, false);
+        link(0, capacity);
+    }
+}
+
+// Takes over storage that already holds the blocks of an earlier heap, such as a
+// persistent arena mapped back in, and relinks its free blocks
+// Returns false, leaving the heap empty, if the tags do not tile the storage
+bool BoundaryTagHeap::adopt(uint8_t* storage, size_t capacityWords, unsigned wordSize, unsigned secondLevelBits) {
+    configure(storage, capacityWords, wordSize, secondLevelBits);
+    for (size_t position = 0; position < capacity;) {
+        size_t tag = header(position);
+        size_t extent = tag >> 1;
+        if (extent < min_extent || extent > capacity - position ||
+            load((position + extent - tag_words) * unit_size) != tag) {
+            configure(storage, 0, wordSize, secondLevelBits);
+            return false;
+        }
+        if (!(tag & 1)) link(position, extent);
+        position += extent;
+    }
+    return true;
+}
+
+// Sets the geometry and empties the free lists without touching the storage
+void BoundaryTagHeap::configure(uint8_t* storage, size_t capacityWords, unsigned wordSize, unsigned secondLevelBits) {
+    base = storage;
+    unit_size = wordSize;
+    sl_bits = secondLevelBits < MAX_SECOND_LEVEL_BITS ? secondLevelBits : MAX_SECOND_LEVEL_BITS;
+    tag_words = (sizeof(size_t) + wordSize - 1) / wordSize;
+    size_t link_words = (2 * sizeof(size_t) + wordSize - 1) / wordSize;
+    min_extent = 2 * tag_words + link_words;
+    capacity = (storage && capacityWords >= min_extent) ? capacityWords : 0;
+
+    bin_heads.assign(LEVEL_COUNT << sl_bits, npos);
+    level_bitmap = 0;
+    bin_bitmaps.assign(LEVEL_COUNT, 0);
+    free_blocks = 0;
+}
+
+// Covers storage that now reaches capacityWords with one more free block, coalesced with
+// the last block when that one is free; false if the new space cannot hold a block
+bool BoundaryTagHeap::extend(size_t capacityWords) {
+    if (!base || capacityWords <= capacity || capacityWords - capacity < min_extent) return false;
+
+    size_t position = capacity;
+    size_t extent = capacityWords - capacity;
+    if (position > 0) {
+        size_t prev_tag = footer_of_previous(position);
+        if (!(prev_tag & 1)) {
+            size_t prev_extent = prev_tag >> 1;
+            unlink(position - prev_extent, prev_extent);
+            position -= prev_extent;
+            extent += prev_extent;
+        }
+    }
+    capacity = capacityWords;
+    write_tags(position, extent, false);
+    link(position, extent);
+    return true;
+}
+
+// Number of words a block needs to carry the given payload
+size_t BoundaryTagHeap::blockExtent(size_t payloadWords) const {
+    size_t extent = payloadWords + 2 * tag_words;
+    return extent < min_extent ? min_extent : extent;
+}
+
+void BoundaryTagHeap::write_tags(size_t position, size_t extent, bool allocated) {
+    size_t tag = (extent << 1) | (allocated ? 1 : 0);
+    store(position * unit_size, tag);
+    store((position + extent - tag_words) * unit_size, tag);
+}
+
+// Size class of a block: floor(log2(extent)), then the sl_bits bits below the leading one
+// Levels below sl_bits have fewer sizes than lists, so each of their sizes gets its own list
+size_t BoundaryTagHeap::bin_of(size_t extent) const {
+    size_t level = 63 - __builtin_clzll(extent);
+    size_t sub = (level >= sl_bits) ? extent >> (level - sl_bits) : extent << (sl_bits - level);
+    return (level << sl_bits) | (sub & ((size_t(1) << sl_bits) - 1));
+}
+
+// First non-empty size class at or above bin, found from the two bitmaps in O(1); npos if none
+size_t BoundaryTagHeap::first_bin_from(size_t bin) const {
+    size_t level = bin >> sl_bits;
+    uint64_t lists = bin_bitmaps[level] & (~0ull << (bin & ((size_t(1) << sl_bits) - 1)));
+    if (lists) return (level << sl_bits) | __builtin_ctzll(lists);
+
+    uint64_t levels = (level + 1 < LEVEL_COUNT) ? level_bitmap & (~0ull << (level + 1)) : 0;
+    if (!levels) return npos;
+    level = __builtin_ctzll(levels);
+    return (level << sl_bits) | __builtin_ctzll(bin_bitmaps[level]);
+}
+
+// Pushes a free block onto the front of its size class list
+void BoundaryTagHeap::link(size_t position, size_t extent) {
+    size_t bin = bin_of(extent);
+    size_t head = bin_heads[bin];
+    store(link_offset(position), head);                   // next
+    store(link_offset(position) + sizeof(size_t), npos);  // prev
+    if (head != npos) store(link_offset(head) + sizeof(size_t), position);
+    bin_heads[bin] = position;
+    bin_bitmaps[bin >> sl_bits] |= 1ull << (bin & ((size_t(1) << sl_bits) - 1));
+    level_bitmap |= 1ull << (bin >> sl_bits);
+    free_blocks++;
+}
+
+// Removes a free block from its size class list in O(1)
+void BoundaryTagHeap::unlink(size_t position, size_t extent) {
+    size_t bin = bin_of(extent);
+    size_t next = load(link_offset(position));
+    size_t prev = load(link_offset(position) + sizeof(size_t));
+    if (prev != npos) {
+        store(link_offset(prev), next);
+    } else {
+        bin_heads[bin] = next;
+        if (next == npos) {
+            bin_bitmaps[bin >> sl_bits] &= ~(1ull << (bin & ((size_t(1) << sl_bits) - 1)));
+            if (!bin_bitmaps[bin >> sl_bits]) level_bitmap &= ~(1ull << (bin >> sl_bits));
+        }
+    }
+    if (next != npos) store(link_offset(next) + sizeof(size_t), prev);
+    free_blocks--;
+}
+
+// Scans one size class for the smallest block of at least extent words
+// Ties go to the lowest position, like the getList() based strategies
+size_t BoundaryTagHeap::smallest_fit_in_bin(size_t bin, size_t extent) const {
+    size_t best = npos;
+    size_t best_extent = 0;
+    for (size_t position = bin_heads[bin]; position != npos; position = load(link_offset(position))) {
+        size_t candidate = header(position) >> 1;
+        if (candidate < extent) continue;
+        if (best == npos || candidate < best_extent || (candidate == best_extent && position < best)) {
+            best = position;
+            best_extent = candidate;
+        }
+    }
+    return best;
+}
+
+// Smallest free block that fits: the request's own bin first, then the next non-empty bin,
+// where every block is large enough
+size_t BoundaryTagHeap::findBestFit(size_t extent) const {
+    if (capacity == 0 || extent > capacity) return npos;
+
+    size_t bin = bin_of(extent);
+    size_t found = smallest_fit_in_bin(bin, extent);
+    if (found != npos || bin + 1 >= bin_heads.size()) return found;
+
+    size_t larger = first_bin_from(bin + 1);
+    return larger == npos ? npos : smallest_fit_in_bin(larger, extent);
+}
+
+// TLSF search: rounds the request up to the next class boundary, so the head of the first
+// non-empty class from there always fits and no list is walked
+// Only when no such class exists is the request's own class searched
+size_t BoundaryTagHeap::findGoodFit(size_t extent) const {
+    if (capacity == 0 || extent > capacity) return npos;
+
+    size_t level = 63 - __builtin_clzll(extent);
+    size_t rounded = (level > sl_bits) ? extent + (size_t(1) << (level - sl_bits)) - 1 : extent;
+    size_t bin = first_bin_from(bin_of(rounded));
+    if (bin != npos) return bin_heads[bin];
+    return smallest_fit_in_bin(bin_of(extent), extent);
+}
+
+// Largest free block, provided it fits
+size_t BoundaryTagHeap::findWorstFit(size_t extent) const {
+    if (!level_bitmap) return npos;
+
+    size_t level = 63 - __builtin_clzll(level_bitmap);
+    size_t bin = (level << sl_bits) | (63 - __builtin_clzll(bin_bitmaps[level]));
+    size_t largest = npos;
+    size_t largest_extent = 0;
+    for (size_t position = bin_heads[bin]; position != npos; position = load(link_offset(position))) {
+        size_t candidate = header(position) >> 1;
+        if (candidate > largest_extent || (candidate == largest_extent && position < largest)) {
+            largest = position;
+            largest_extent = candidate;
+        }
+    }
+    return largest_extent >= extent ? largest : npos;
+}
+
+// Allocates extent words from the free block at position, splitting off the tail
+// when it is large enough to stand as a block of its own
+// Returns the extent of the allocated block, or 0 if position holds no such free block
+size_t BoundaryTagHeap::carve(size_t position, size_t extent) {
+    if (position >= capacity) return 0;
+    size_t tag = header(position);
+    size_t available = tag >> 1;
+    if ((tag & 1) || available < extent) return 0;
+
+    unlink(position, available);
+    if (available - extent >= min_extent) {
+        write_tags(position, extent, true);
+        write_tags(position + extent, available - extent, false);
+        link(position + extent, available - extent);
+        return extent;
+    }
+    write_tags(position, available, true);
+    return available;
+}
+
+// Splits the free block at position into free blocks of lead words and the rest
+// Both parts must be able to stand as blocks of their own
+bool BoundaryTagHeap::splitFront(size_t position, size_t lead) {
+    if (position >= capacity) return false;
+    size_t tag = header(position);
+    size_t available = tag >> 1;
+    if ((tag & 1) || lead < min_extent || available < lead + min_extent) return false;
+
+    unlink(position, available);
+    write_tags(position, lead, false);
+    link(position, lead);
+    write_tags(position + lead, available - lead, false);
+    link(position + lead, available - lead);
+    return true;
+}
+
+// Grows or shrinks the allocated block at position to extent words without moving it
+// Growing takes space from the following block when that one is free; shrinking frees the
+// tail when it is large enough to stand as a block of its own
+// Returns the block's new extent, or 0 if it cannot grow in place
+size_t BoundaryTagHeap::resize(size_t position, size_t extent) {
+    size_t current = header(position) >> 1;
+    if (extent <= current) {
+        if (current - extent < min_extent) return current;
+        write_tags(position, extent, true);
+        write_tags(position + extent, current - extent, true);
+        release(position + extent, false);  // Coalesces the tail with a free successor
+        return extent;
+    }
+
+    size_t next = position + current;
+    if (next >= capacity) return 0;
+    size_t next_tag = header(next);
+    size_t total = current + (next_tag >> 1);
+    if ((next_tag & 1) || total < extent) return 0;
+
+    unlink(next, next_tag >> 1);
+    if (total - extent >= min_extent) {
+        write_tags(position, extent, true);
+        write_tags(position + extent, total - extent, false);
+        link(position + extent, total - extent);
+        return extent;
+    }
+    write_tags(position, total, true);
+    return total;
+}
+
+// True when position carries a consistent pair of allocated tags
+bool BoundaryTagHeap::holdsAllocatedBlock(size_t position) const {
+    if (position >= capacity || capacity - position < min_extent) return false;
+    size_t tag = header(position);
+    size_t extent = tag >> 1;
+    if (!(tag & 1) || extent < min_extent || extent > capacity - position) return false;
+    return load((position + extent - tag_words) * unit_size) == tag;
+}
+
+// Frees the block at position and coalesces it with free physical neighbours
+// With validate set, positions that do not carry a consistent allocated tag are rejected
+// Returns the extent of the block freed, before coalescing, or 0 if it was rejected;
+// holePosition and holeExtent, when given, receive the free block it ended up in
+size_t BoundaryTagHeap::release(size_t position, bool validate, size_t* holePosition, size_t* holeExtent) {
+    if (validate && !holdsAllocatedBlock(position)) return 0;
+
+    size_t extent = header(position) >> 1;
+    size_t released = extent;
+
+    size_t next = position + extent;
+    if (next < capacity) {
+        size_t next_tag = header(next);
+        if (!(next_tag & 1)) {
+            unlink(next, next_tag >> 1);
+            extent += next_tag >> 1;
+        }
+    }
+
+    if (position > 0) {
+        size_t prev_tag = footer_of_previous(position);
+        if (!(prev_tag & 1)) {
+            size_t prev_extent = prev_tag >> 1;
+            unlink(position - prev_extent, prev_extent);
+            position -= prev_extent;
+            extent += prev_extent;
+        }
+    }
+
+    write_tags(position, extent, false);
+    link(position, extent);
+    if (holePosition) *holePosition = position;
+    if (holeExtent) *holeExtent = extent;
+    return released;
+}
@@ -0,0 +1,92 @@
+#ifndef BOUNDARY_TAG_HEAP_H
+#define BOUNDARY_TAG_HEAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Block allocator that keeps all of its metadata inside the managed storage
+// Every block starts with a header tag and ends with a footer tag, each holding
+// (extent << 1) | allocated, so a block and both of its physical neighbours are
+// found by pointer arithmetic alone. Free blocks additionally hold the links of
+// a segregated free list in their payload, so once reset() has run no
+// out-of-band memory is touched by carve() or release().
+// Free lists are segregated in two levels, as in TLSF: the first level by power
+// of two, the second by the next secondLevelBits bits of the extent. With no
+// second level bits there is one list per power of two.
+// All positions and extents are in words and include the tags.
+class BoundaryTagHeap {
+private:
+    static constexpr size_t LEVEL_COUNT = 64;  // One first level per power of two
+
+    uint8_t* base;
+    size_t capacity;          // Words covered by blocks
+    unsigned unit_size;
+    size_t tag_words;         // Words taken by one header or footer
+    size_t min_extent;        // Smallest block that can hold both tags and the free links
+    unsigned sl_bits;         // Second level lists per power of two, as a power of two
+    std::vector<size_t> bin_heads;  // First free block of each size class, or npos
+    uint64_t level_bitmap;    // Bit l set when first level l has a non-empty list
+    std::vector<uint64_t> bin_bitmaps;  // Per first level: bit s set when its list s is non-empty
+    size_t free_blocks;
+
+    size_t load(size_t byte_offset) const {
+        size_t value;
+        std::memcpy(&value, base + byte_offset, sizeof(value));
+        return value;
+    }
+    void store(size_t byte_offset, size_t value) {
+        std::memcpy(base + byte_offset, &value, sizeof(value));
+    }
+    size_t header(size_t position) const { return load(position * unit_size); }
+    size_t footer_of_previous(size_t position) const { return load((position - tag_words) * unit_size); }
+    size_t link_offset(size_t position) const { return (position + tag_words) * unit_size; }
+
+    void configure(uint8_t* storage, size_t capacityWords, unsigned wordSize, unsigned secondLevelBits);
+    void write_tags(size_t position, size_t extent, bool allocated);
+    size_t bin_of(size_t extent) const;
+    size_t first_bin_from(size_t bin) const;
+    void link(size_t position, size_t extent);
+    void unlink(size_t position, size_t extent);
+    size_t smallest_fit_in_bin(size_t bin, size_t extent) const;
+
+public:
+    static constexpr size_t npos = SIZE_MAX;
+
+    BoundaryTagHeap();
+
+    static constexpr unsigned MAX_SECOND_LEVEL_BITS = 6;
+
+    void reset(uint8_t* storage, size_t capacityWords, unsigned wordSize, unsigned secondLevelBits = 0);
+    bool adopt(uint8_t* storage, size_t capacityWords, unsigned wordSize, unsigned secondLevelBits = 0);
+    bool extend(size_t capacityWords);
+    size_t blockExtent(size_t payloadWords) const;
+    size_t payloadOffset() const { return tag_words; }
+    size_t linkWords() const { return min_extent - 2 * tag_words; }
+    size_t minExtent() const { return min_extent; }
+    size_t extentAt(size_t position) const { return header(position) >> 1; }
+    bool allocatedAt(size_t position) const { return (header(position) & 1) != 0; }
+    size_t capacityWords() const { return capacity; }
+    size_t freeBlockCount() const { return free_blocks; }
+    size_t findBestFit(size_t extent) const;
+    size_t findGoodFit(size_t extent) const;
+    size_t findWorstFit(size_t extent) const;
+    bool holdsAllocatedBlock(size_t position) const;
+    size_t carve(size_t position, size_t extent);
+    bool splitFront(size_t position, size_t lead);
+    size_t resize(size_t position, size_t extent);
+    size_t release(size_t position, bool validate, size_t* holePosition = nullptr, size_t* holeExtent = nullptr);
+
+    // Visits every block in address order as visit(position, extent, allocated)
+    template <typename Visitor>
+    void forEachBlock(Visitor visit) const {
+        for (size_t position = 0; position < capacity;) {
+            size_t tag = header(position);
+            visit(position, tag >> 1, (tag & 1) != 0);
+            position += tag >> 1;
+        }
+    }
+};
+
+#endif
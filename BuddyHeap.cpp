@@ -0,0 +1,290 @@
+#include "BuddyHeap.h"
+
+BuddyHeap::BuddyHeap()
+    : base(nullptr), capacity(0), unit_size(1), min_order(0), top_order(0), order_bitmap(0), free_blocks(0) {}
+
+// Covers the storage area with the largest aligned free blocks that fit
+// Words past the last whole minimum-size block are never handed out
+void BuddyHeap::reset(uint8_t* storage, size_t capacityWords, unsigned wordSize) {
+    base = storage;
+    unit_size = wordSize;
+    size_t link_words = (2 * sizeof(size_t) + wordSize - 1) / wordSize;
+    min_order = 0;
+    while ((size_t(1) << min_order) < link_words) min_order++;
+    capacity = storage ? capacityWords & ~((size_t(1) << min_order) - 1) : 0;
+    top_order = min_order;
+    while ((size_t(1) << top_order) < capacity) top_order++;
+
+    order_heads.assign(ORDER_COUNT, npos);
+    order_bitmap = 0;
+    free_blocks = 0;
+    size_t nodes = capacity ? size_t(2) << (top_order - min_order) : 0;
+    split_bits.assign((nodes + 63) / 64, 0);
+    free_bits.assign((nodes + 63) / 64, 0);
+    if (capacity > 0) lay_blocks(0, top_order);
+}
+
+// Frees the order block at position when it lies inside the storage, splitting it
+// when it only partly does
+void BuddyHeap::lay_blocks(size_t position, size_t order) {
+    if (position >= capacity) return;
+    if (position + (size_t(1) << order) <= capacity) {
+        link(position, order);
+        return;
+    }
+    set(split_bits, node(position, order));
+    lay_blocks(position, order - 1);
+    lay_blocks(position + (size_t(1) << (order - 1)), order - 1);
+}
+
+// Takes over storage that already holds the given (position, extent) allocated blocks
+// of an earlier heap, such as a persistent arena mapped back in
+// Rebuilding links free blocks through storage that allocated blocks later claim, so the
+// first bytes of each allocated block are saved beforehand and put back afterwards.
+void BuddyHeap::adopt(uint8_t* storage, size_t capacityWords, unsigned wordSize,
+                      const std::vector<std::pair<size_t, size_t>>& allocated) {
+    const size_t link_bytes = 2 * sizeof(size_t);
+    std::vector<uint8_t> saved(allocated.size() * link_bytes);
+    for (size_t i = 0; i < allocated.size(); ++i) {
+        if (allocated[i].first < capacityWords) std::memcpy(&saved[i * link_bytes], storage + allocated[i].first * wordSize, link_bytes);
+    }
+    reset(storage, capacityWords, wordSize);
+    std::vector<bool> claimed(allocated.size());
+    for (size_t i = 0; i < allocated.size(); ++i) {
+        claimed[i] = claim(allocated[i].first, allocated[i].second) != 0;
+    }
+    for (size_t i = 0; i < allocated.size(); ++i) {
+        if (claimed[i]) std::memcpy(base + allocated[i].first * unit_size, &saved[i * link_bytes], link_bytes);
+    }
+}
+
+// Grows the heap over storage that now reaches capacityWords
+// The blocks past the old end were never free; those now inside are released, merging
+// with free buddies as usual, and those straddling the new end are split first. Blocks
+// in use do not move.
+bool BuddyHeap::extend(size_t capacityWords) {
+    size_t usable = capacityWords & ~((size_t(1) << min_order) - 1);
+    if (!base || usable <= capacity) return false;
+    if (capacity == 0) {
+        reset(base, capacityWords, unit_size);
+        return true;
+    }
+
+    size_t order = top_order;
+    while ((size_t(1) << order) < usable) order++;
+    if (order > top_order) raise_root(order);
+
+    size_t position = capacity;
+    capacity = usable;
+    while (position < capacity) {
+        size_t block = block_order_at(position);
+        if (position + (size_t(1) << block) > capacity) {
+            set(split_bits, node(position, block));
+            continue;
+        }
+        release(position);
+        position += size_t(1) << block;
+    }
+    return true;
+}
+
+// Makes the tree order levels deep, with the old root as the leftmost node of its order
+// Node indices depend on the depth of the tree, so both bitmaps are rebuilt
+void BuddyHeap::raise_root(size_t order) {
+    size_t nodes = size_t(2) << (order - min_order);
+    std::vector<uint64_t> split_raised((nodes + 63) / 64, 0);
+    std::vector<uint64_t> free_raised((nodes + 63) / 64, 0);
+    auto move_bits = [&](const std::vector<uint64_t>& from, std::vector<uint64_t>& to) {
+        for (size_t word = 0; word < from.size(); ++word) {
+            for (uint64_t bits = from[word]; bits; bits &= bits - 1) {
+                size_t index = word * 64 + __builtin_ctzll(bits);
+                size_t depth = 63 - __builtin_clzll(index);
+                size_t block = top_order - depth;
+                size_t position = (index - (size_t(1) << depth)) << block;
+                set(to, (size_t(1) << (order - block)) + (position >> block));
+            }
+        }
+    };
+    move_bits(split_bits, split_raised);
+    move_bits(free_bits, free_raised);
+    split_bits.swap(split_raised);
+    free_bits.swap(free_raised);
+
+    // The old root's new ancestors are split; their right halves lie past the end
+    size_t old_top = top_order;
+    top_order = order;
+    for (size_t level = old_top + 1; level <= top_order; ++level) set(split_bits, node(0, level));
+}
+
+// Smallest order whose blocks hold extent words, or npos when even the root is too small
+size_t BuddyHeap::order_of(size_t extent) const {
+    if (extent <= (size_t(1) << min_order)) return min_order;
+    size_t order = 64 - __builtin_clzll(extent - 1);
+    return order > top_order ? npos : order;
+}
+
+// Number of words a block needs to carry the given payload
+// Requests larger than the whole tree come back unchanged, and no block fits them
+size_t BuddyHeap::blockExtent(size_t payloadWords) const {
+    size_t order = order_of(payloadWords);
+    return order == npos ? payloadWords : size_t(1) << order;
+}
+
+// Power-of-two extent a payload rounds up to, however large the tree
+// Reads nothing extend() changes, so it may be called without the caller's lock
+size_t BuddyHeap::classExtent(size_t payloadWords) const {
+    if (payloadWords <= (size_t(1) << min_order)) return size_t(1) << min_order;
+    return size_t(1) << (64 - __builtin_clzll(payloadWords - 1));
+}
+
+// Order of the block starting at position, free or allocated; npos if no block starts there
+// A block is the first node on the way up whose parent is split
+size_t BuddyHeap::block_order_at(size_t position) const {
+    if (position >= capacity) return npos;
+    for (size_t order = min_order; order <= top_order; ++order) {
+        if (position & ((size_t(1) << order) - 1)) return npos;  // Inside a larger block
+        if (order == top_order || test(split_bits, node(position, order + 1))) return order;
+    }
+    return npos;
+}
+
+// Pushes a free block onto the front of its order's list
+void BuddyHeap::link(size_t position, size_t order) {
+    size_t head = order_heads[order];
+    store(position * unit_size, head);                   // next
+    store(position * unit_size + sizeof(size_t), npos);  // prev
+    if (head != npos) store(head * unit_size + sizeof(size_t), position);
+    order_heads[order] = position;
+    order_bitmap |= 1ull << order;
+    set(free_bits, node(position, order));
+    free_blocks++;
+}
+
+// Removes a free block from its order's list in O(1)
+void BuddyHeap::unlink(size_t position, size_t order) {
+    size_t next = load(position * unit_size);
+    size_t prev = load(position * unit_size + sizeof(size_t));
+    if (prev != npos) {
+        store(prev * unit_size, next);
+    } else {
+        order_heads[order] = next;
+        if (next == npos) order_bitmap &= ~(1ull << order);
+    }
+    if (next != npos) store(next * unit_size + sizeof(size_t), prev);
+    clear(free_bits, node(position, order));
+    free_blocks--;
+}
+
+// A free block of the smallest order that holds extent words
+size_t BuddyHeap::findBestFit(size_t extent) const {
+    size_t order = order_of(extent);
+    if (order == npos) return npos;
+    uint64_t candidates = order_bitmap & (~0ull << order);
+    return candidates ? order_heads[__builtin_ctzll(candidates)] : npos;
+}
+
+// A free block of the largest order, provided it holds extent words
+size_t BuddyHeap::findWorstFit(size_t extent) const {
+    size_t order = order_of(extent);
+    if (order == npos || !order_bitmap) return npos;
+    size_t largest = 63 - __builtin_clzll(order_bitmap);
+    return largest >= order ? order_heads[largest] : npos;
+}
+
+// Allocates a block of extent words, rounded up to a power of two, from the start of
+// the free block at position, freeing the upper halves split off on the way down
+// Returns the extent of the allocated block, or 0 if position holds no large enough free block
+size_t BuddyHeap::carve(size_t position, size_t extent) {
+    size_t order = order_of(extent);
+    size_t current = block_order_at(position);
+    if (order == npos || current == npos || current < order || !is_free(position, current)) return 0;
+
+    unlink(position, current);
+    while (current > order) {
+        set(split_bits, node(position, current));
+        current--;
+        link(position + (size_t(1) << current), current);
+    }
+    return size_t(1) << order;
+}
+
+// Allocates the block of extent words at position out of whichever free block contains it,
+// splitting that block down and freeing the halves left over, as when heap state is rebuilt
+// from a list of allocated blocks. Returns the extent allocated, or 0 if position is not
+// aligned to it or not inside a free block.
+size_t BuddyHeap::claim(size_t position, size_t extent) {
+    size_t order = order_of(extent);
+    if (order == npos || (position & ((size_t(1) << order) - 1)) || position >= capacity) return 0;
+
+    size_t start = npos;
+    size_t current = order;
+    for (; current <= top_order; ++current) {
+        size_t candidate = position & ~((size_t(1) << current) - 1);
+        if (block_order_at(candidate) == current) {
+            start = candidate;
+            break;
+        }
+    }
+    if (start == npos || !is_free(start, current)) return 0;
+
+    unlink(start, current);
+    while (current > order) {
+        set(split_bits, node(start, current));
+        current--;
+        size_t half = size_t(1) << current;
+        if (position >= start + half) {
+            link(start, current);
+            start += half;
+        } else {
+            link(start + half, current);
+        }
+    }
+    return size_t(1) << order;
+}
+
+// Grows or shrinks the allocated block at position to the order holding extent words
+// Shrinking frees the upper halves; growing needs the block to be the lower half at each
+// order on the way up, with a free buddy, and nothing changes unless all of them are
+// Returns the block's new extent, or 0 if it cannot be resized in place
+size_t BuddyHeap::resize(size_t position, size_t extent) {
+    size_t order = block_order_at(position);
+    size_t wanted = order_of(extent);
+    if (order == npos || wanted == npos || is_free(position, order)) return 0;
+
+    for (size_t current = order; current < wanted; ++current) {
+        size_t buddy = position + (size_t(1) << current);
+        if ((position & (size_t(1) << current)) || buddy >= capacity || !is_free(buddy, current)) return 0;
+    }
+    for (; order < wanted; ++order) {
+        unlink(position + (size_t(1) << order), order);
+        clear(split_bits, node(position, order + 1));
+    }
+    for (; order > wanted; --order) {
+        set(split_bits, node(position, order));
+        link(position + (size_t(1) << (order - 1)), order - 1);
+    }
+    return size_t(1) << order;
+}
+
+// Frees the block at position and merges it with its buddy for as long as the buddy is free
+// Positions that do not start an allocated block are rejected
+// Returns the extent of the block freed, before merging, or 0 if it was rejected;
+// holePosition and holeExtent, when given, receive the free block it ended up in
+size_t BuddyHeap::release(size_t position, size_t* holePosition, size_t* holeExtent) {
+    size_t order = block_order_at(position);
+    if (order == npos || is_free(position, order)) return 0;
+    size_t released = size_t(1) << order;
+
+    while (order < top_order) {
+        size_t buddy = position ^ (size_t(1) << order);
+        if (buddy >= capacity || !is_free(buddy, order)) break;
+        unlink(buddy, order);
+        position &= ~(size_t(1) << order);
+        order++;
+        clear(split_bits, node(position, order));
+    }
+    link(position, order);
+    if (holePosition) *holePosition = position;
+    if (holeExtent) *holeExtent = size_t(1) << order;
+    return released;
+}
@@ -0,0 +1,96 @@
+#ifndef BUDDY_HEAP_H
+#define BUDDY_HEAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+// Binary buddy allocator over a storage area
+// Blocks are 2^order words and aligned to their size, so a block's buddy is found
+// by flipping one bit of its position. Free blocks are linked, by order, through
+// their first bytes; two bitmaps over the implicit tree of blocks record which
+// blocks are split and which are free. Splitting and coalescing are O(log N) and
+// never scan a list.
+// Storage that does not fill a whole power of two is covered by the largest
+// aligned blocks that fit; the remainder of the tree is never handed out, so its
+// blocks are never free and coalescing stops at them.
+// All positions and extents are in words.
+class BuddyHeap {
+private:
+    static constexpr size_t ORDER_COUNT = 64;
+
+    uint8_t* base;
+    size_t capacity;          // Words covered by usable blocks
+    unsigned unit_size;
+    size_t min_order;         // Smallest block that can hold the free links
+    size_t top_order;         // Order of the root of the tree
+    std::vector<size_t> order_heads;  // First free block of each order, or npos
+    uint64_t order_bitmap;    // Bit k set when order k has a free block
+    std::vector<uint64_t> split_bits;  // One bit per tree node: split into two halves
+    std::vector<uint64_t> free_bits;   // One bit per tree node: a free block on its list
+    size_t free_blocks;
+
+    size_t load(size_t byte_offset) const {
+        size_t value;
+        std::memcpy(&value, base + byte_offset, sizeof(value));
+        return value;
+    }
+    void store(size_t byte_offset, size_t value) {
+        std::memcpy(base + byte_offset, &value, sizeof(value));
+    }
+
+    // Index of the order k block at position in the implicit tree; the root is 1
+    size_t node(size_t position, size_t order) const {
+        return (size_t(1) << (top_order - order)) + (position >> order);
+    }
+    static bool test(const std::vector<uint64_t>& bits, size_t index) { return (bits[index / 64] >> (index % 64)) & 1; }
+    static void set(std::vector<uint64_t>& bits, size_t index) { bits[index / 64] |= 1ull << (index % 64); }
+    static void clear(std::vector<uint64_t>& bits, size_t index) { bits[index / 64] &= ~(1ull << (index % 64)); }
+    bool is_free(size_t position, size_t order) const { return test(free_bits, node(position, order)); }
+
+    size_t order_of(size_t extent) const;
+    size_t block_order_at(size_t position) const;
+    void lay_blocks(size_t position, size_t order);
+    void raise_root(size_t order);
+    void link(size_t position, size_t order);
+    void unlink(size_t position, size_t order);
+
+public:
+    static constexpr size_t npos = SIZE_MAX;
+
+    BuddyHeap();
+
+    void reset(uint8_t* storage, size_t capacityWords, unsigned wordSize);
+    void adopt(uint8_t* storage, size_t capacityWords, unsigned wordSize,
+               const std::vector<std::pair<size_t, size_t>>& allocated);
+    bool extend(size_t capacityWords);
+    size_t blockExtent(size_t payloadWords) const;
+    size_t classExtent(size_t payloadWords) const;
+    size_t extentAt(size_t position) const {
+        size_t order = block_order_at(position);
+        return order == npos ? 0 : size_t(1) << order;
+    }
+    bool allocatedAt(size_t position) const { return !is_free(position, block_order_at(position)); }
+    size_t capacityWords() const { return capacity; }
+    size_t freeBlockCount() const { return free_blocks; }
+    size_t findBestFit(size_t extent) const;
+    size_t findWorstFit(size_t extent) const;
+    size_t carve(size_t position, size_t extent);
+    size_t claim(size_t position, size_t extent);
+    size_t resize(size_t position, size_t extent);
+    size_t release(size_t position, size_t* holePosition = nullptr, size_t* holeExtent = nullptr);
+
+    // Visits every block in address order as visit(position, extent, allocated)
+    template <typename Visitor>
+    void forEachBlock(Visitor visit) const {
+        for (size_t position = 0; position < capacity;) {
+            size_t order = block_order_at(position);
+            visit(position, size_t(1) << order, !is_free(position, order));
+            position += size_t(1) << order;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,46 @@
+#include "LatencyHistogram.h"
+#include <algorithm>
+#include <thread>
+
+// Measured once against steady_clock over a few milliseconds
+double LatencyHistogram::nanosecondsPerTick() {
+#if defined(__x86_64__) || defined(__i386__)
+    static const double ratio = [] {
+        auto clock_start = std::chrono::steady_clock::now();
+        uint64_t tick_start = now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        uint64_t ticks = now() - tick_start;
+        double nanoseconds = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - clock_start).count();
+        return ticks ? nanoseconds / ticks : 1.0;
+    }();
+    return ratio;
+#else
+    return 1.0;
+#endif
+}
+
+uint64_t LatencyHistogram::count() const {
+    uint64_t total = 0;
+    for (const auto& bucket : buckets) total += bucket.load(std::memory_order_relaxed);
+    return total;
+}
+
+// Walks the buckets until fraction of the samples lie at or below one; 0 with no samples
+uint64_t LatencyHistogram::percentile(double fraction) const {
+    uint64_t total = count();
+    if (total == 0) return 0;
+    uint64_t wanted = static_cast<uint64_t>(fraction * total + 0.5);
+    if (wanted == 0) wanted = 1;
+
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+        seen += buckets[bucket].load(std::memory_order_relaxed);
+        if (seen >= wanted) return std::min(bucketLimit(bucket), max());
+    }
+    return max();
+}
+
+void LatencyHistogram::reset() {
+    for (auto& bucket : buckets) bucket.store(0, std::memory_order_relaxed);
+    largest.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,69 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Log-linear histogram of durations in clock ticks, in the manner of HdrHistogram
+// Each power of two is split into 2^SUB_BITS equal buckets, so any recorded value is
+// known to within 1/8 of itself over the whole 64-bit range with a fixed 4 KiB of
+// counters. Buckets are relaxed atomics, so any thread may record.
+// Ticks come from the time stamp counter on x86 and steady_clock elsewhere;
+// nanosecondsPerTick() converts.
+class LatencyHistogram {
+public:
+    static constexpr size_t SUB_BITS = 3;
+    static constexpr size_t SUB_BUCKETS = size_t(1) << SUB_BITS;
+    static constexpr size_t BUCKET_COUNT = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+private:
+    std::atomic<uint64_t> buckets[BUCKET_COUNT] = {};
+    std::atomic<uint64_t> largest{0};
+
+    // Values below SUB_BUCKETS have a bucket each; above, the leading bit picks the row
+    // and the SUB_BITS bits after it the bucket within the row
+    static size_t bucket_of(uint64_t ticks) {
+        if (ticks < SUB_BUCKETS) return ticks;
+        size_t level = 63 - __builtin_clzll(ticks);
+        size_t sub = (ticks >> (level - SUB_BITS)) & (SUB_BUCKETS - 1);
+        return (level - SUB_BITS + 1) * SUB_BUCKETS + sub;
+    }
+
+public:
+    static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+    static double nanosecondsPerTick();
+
+    // Largest value that falls in bucket
+    static uint64_t bucketLimit(size_t bucket) {
+        if (bucket < SUB_BUCKETS) return bucket;
+        size_t level = bucket / SUB_BUCKETS + SUB_BITS - 1;
+        uint64_t sub = bucket % SUB_BUCKETS;
+        return ((SUB_BUCKETS + sub + 1) << (level - SUB_BITS)) - 1;
+    }
+
+    void record(uint64_t ticks) {
+        buckets[bucket_of(ticks)].fetch_add(1, std::memory_order_relaxed);
+        uint64_t seen = largest.load(std::memory_order_relaxed);
+        while (ticks > seen && !largest.compare_exchange_weak(seen, ticks, std::memory_order_relaxed)) {}
+    }
+
+    uint64_t count() const;
+    uint64_t max() const { return largest.load(std::memory_order_relaxed); }
+    uint64_t countAt(size_t bucket) const { return buckets[bucket].load(std::memory_order_relaxed); }
+    uint64_t percentile(double fraction) const;  // Upper bound on the given quantile, in ticks
+    void reset();
+};
+
+#endif
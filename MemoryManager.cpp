@@ -1,42 +1,664 @@
 #include "MemoryManager.h"
+#include "NumaPlacement.h"
 #include <algorithm>
+#include <charconv>
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
+#include <cerrno>
+#include <cstdio>
 #include <cstring>
+#include <new>
+#include <string>
+
+namespace {
+
+std::atomic<uint64_t> next_instance_id{1};
+
+// Caches the calling thread holds, one per manager instance it has used
+// On thread exit the caches are flagged so their managers can take the blocks back
+struct ThreadCacheSlots {
+    std::vector<std::pair<uint64_t, std::shared_ptr<ThreadCache>>> entries;
+    ~ThreadCacheSlots() {
+        for (auto& entry : entries) {
+            entry.second->orphaned.store(true, std::memory_order_release);
+        }
+    }
+};
+
+thread_local ThreadCacheSlots cache_slots;
+
+// Writes every part, resuming after short writes; false on error
+bool write_all(int fd, iovec* parts, int count) {
+    while (count > 0) {
+        ssize_t written = writev(fd, parts, count);
+        if (written < 0) return false;
+        for (; count > 0 && static_cast<size_t>(written) >= parts->iov_len; ++parts, --count) {
+            written -= parts->iov_len;
+        }
+        if (count > 0) {
+            parts->iov_base = static_cast<uint8_t*>(parts->iov_base) + written;
+            parts->iov_len -= written;
+        }
+    }
+    return true;
+}
+
+void append_le64(std::vector<uint8_t>& out, uint64_t value) {
+    for (int i = 0; i < 8; ++i) out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+// First page of a persistent arena's file; the storage area follows it
+// The list of allocated blocks, for the backends that keep it out of band, is written
+// after the storage area by persist(). All fields are native-endian: a file is only
+// restored on the kind of machine that wrote it.
+struct PersistentHeader {
+    char magic[8];
+    uint64_t word_size;
+    uint64_t capacity;           // Words
+    uint64_t backend;
+    uint64_t second_level_bits;
+    uint64_t clean;              // Set by persist(), cleared by the first change after it
+    uint64_t block_count;        // (position, extent) pairs after the storage area
+    uint64_t root;               // setRoot()
+};
+
+constexpr char PERSISTENT_MAGIC[8] = {'M', 'M', 'P', 'E', 'R', 'S', '0', '1'};
+constexpr size_t PERSISTENT_HEADER_BYTES = MemoryManager::STORAGE_ALIGNMENT;
+
+PersistentHeader* header_of(uint8_t* storage) {
+    return reinterpret_cast<PersistentHeader*>(storage - PERSISTENT_HEADER_BYTES);
+}
+
+// Where the block list starts in the file
+off_t block_list_offset(size_t capacity, unsigned wordSize) {
+    return (PERSISTENT_HEADER_BYTES + capacity * wordSize + 7) / 8 * 8;
+}
+
+// Reads the header and block list of an existing persistent arena file and checks them
+// against each other and the file's length; false if they do not describe an arena of
+// wordSize that can be restored
+bool read_arena_file(int fd, unsigned wordSize, PersistentHeader& header, std::vector<std::pair<size_t, size_t>>& blocks) {
+    struct stat file;
+    if (fstat(fd, &file) != 0 || pread(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))) {
+        return false;
+    }
+    if (std::memcmp(header.magic, PERSISTENT_MAGIC, sizeof(PERSISTENT_MAGIC)) != 0 || header.clean != 1 ||
+        header.word_size != wordSize || header.backend > static_cast<uint64_t>(MemoryManager::Backend::Tlsf)) {
+        return false;
+    }
+
+    // The storage and the block list must both lie inside the file, or touching them raises SIGBUS
+    size_t file_bytes = static_cast<size_t>(file.st_size);
+    if (file_bytes < PERSISTENT_HEADER_BYTES || header.capacity > (file_bytes - PERSISTENT_HEADER_BYTES) / wordSize) {
+        return false;
+    }
+    size_t list_offset = block_list_offset(header.capacity, wordSize);
+    if (list_offset > file_bytes || header.block_count > (file_bytes - list_offset) / sizeof(blocks[0])) return false;
+
+    blocks.resize(header.block_count);
+    size_t list_bytes = blocks.size() * sizeof(blocks[0]);
+    if (list_bytes > 0 && pread(fd, blocks.data(), list_bytes, list_offset) != static_cast<ssize_t>(list_bytes)) {
+        return false;
+    }
+
+    // Blocks are listed in address order, without overlaps, inside the storage
+    size_t end = 0;
+    for (const auto& block : blocks) {
+        if (block.first < end || block.first >= header.capacity || block.second == 0 ||
+            block.second > header.capacity - block.first) {
+            return false;
+        }
+        end = block.first + block.second;
+    }
+    return true;
+}
+
+}  // namespace
 
 // Constructor initializes the memory manager with specified word size and allocation strategy
 // wordSize: The size of each memory word in bytes
 // allocator: A function pointer to the allocation strategy (e.g., bestFit or worstFit)
 MemoryManager::MemoryManager(unsigned wordSize, std::function<int(int, void*)> allocator) 
-    : unit_size(wordSize), selector(allocator), storage_area(nullptr), total_capacity(0) {}
+    : unit_size(wordSize), selector(allocator), strategy(classify_selector(allocator)),
+      storage_area(nullptr), total_capacity(0), mapped_bytes(0), committed_bytes(0),
+      reserved_capacity(0), page_bytes(0), release_bytes(0), numa_node(-1),
+      persistent_fd(-1), persisted_clean(false), restored(false),
+      backend(Backend::Regions), debug_checks(false), deferred_limit(0), deferred_count(0),
+      concurrent(false), thread_cache_limit(0), instance_id(0), timing(false), compact_cursor(0) {
+    bind_fit_state();
+}
+
+// Same as above with a selector that works on 64-bit positions through a HoleView
+MemoryManager::MemoryManager(unsigned wordSize, HoleSelector allocator)
+    : unit_size(wordSize), hole_selector(allocator), strategy(classify_selector(allocator)),
+      storage_area(nullptr), total_capacity(0), mapped_bytes(0), committed_bytes(0),
+      reserved_capacity(0), page_bytes(0), release_bytes(0), numa_node(-1),
+      persistent_fd(-1), persisted_clean(false), restored(false),
+      backend(Backend::Regions), debug_checks(false), deferred_limit(0), deferred_count(0),
+      concurrent(false), thread_cache_limit(0), instance_id(0), timing(false), compact_cursor(0) {
+    bind_fit_state();
+}
 
 // Destructor ensures proper cleanup of allocated memory
 MemoryManager::~MemoryManager() {
     shutdown();
 }
 
-// Combines adjacent free memory regions to prevent fragmentation
-// This is called after freeing memory to consolidate available space
-void MemoryManager::merge_adjacent_regions() {
-    if (memory_regions.size() < 2) return;
-    
-    auto current = memory_regions.begin();
-    while (current != memory_regions.end() - 1) {
-        auto next = current + 1;
-        // If both current and next regions are available, merge them
-        if (current->available && next->available) {
-            current->extent += next->extent;  // Add next region's size to current
-            memory_regions.erase(next);       // Remove the next region
+// Adds to a counter that may be bumped outside the lock
+// Without concurrent mode only the owner touches it, so the locked read-modify-write is skipped
+void MemoryManager::bump(std::atomic<size_t>& counter, size_t amount) {
+    if (concurrent) {
+        counter.fetch_add(amount, std::memory_order_relaxed);
+    } else {
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+}
+
+// Counts one allocation request, by the power of two its size rounds up to
+void MemoryManager::count_allocation(size_t sizeInBytes, bool succeeded) {
+#if MEMORY_MANAGER_STATS
+    if (!succeeded) {
+        bump(stats.failed_allocations);
+        return;
+    }
+    bump(stats.allocations);
+    size_t size_class = sizeInBytes <= 1 ? 0 : 64 - __builtin_clzll(sizeInBytes - 1);
+    bump(stats.size_classes[std::min(size_class, Stats::SIZE_CLASS_COUNT - 1)]);
+#else
+    (void)sizeInBytes;
+    (void)succeeded;
+#endif
+}
+
+// Records words leaving the free space; the caller holds the lock if one is needed
+void MemoryManager::mark_allocated(size_t position, size_t extent) {
+    if (persisted_clean) mark_dirty();
+    allocation_bits.setRange(position, extent);
+#if MEMORY_MANAGER_STATS
+    stats.in_use_words += extent;
+    stats.peak_words = std::max(stats.peak_words, stats.in_use_words);
+#endif
+}
+
+// Records words returning to the free space; the caller holds the lock if one is needed
+void MemoryManager::mark_free(size_t position, size_t extent) {
+    if (persisted_clean) mark_dirty();
+    allocation_bits.clearRange(position, extent);
+#if MEMORY_MANAGER_STATS
+    stats.in_use_words -= extent;
+#endif
+}
+
+// Tick count to time an operation from, or 0 when timing is off
+uint64_t MemoryManager::start_timer() const {
+#if MEMORY_MANAGER_STATS
+    if (timing) return LatencyHistogram::now();
+#endif
+    return 0;
+}
+
+void MemoryManager::stop_timer(TimedOperation operation, uint64_t started) {
+#if MEMORY_MANAGER_STATS
+    if (started) latency[static_cast<size_t>(operation)].record(LatencyHistogram::now() - started);
+#else
+    (void)operation;
+    (void)started;
+#endif
+}
+
+// Follows up a release that left the free hole [position, position + extent), released
+// words of which were just freed: traces a coalesce if neighbours were taken in, then
+// hands the hole's pages back
+void MemoryManager::settle_hole(size_t position, size_t extent, size_t released) {
+    if (trace_hook && extent > released) {
+        trace_hook(TraceEvent::Coalesce, storage_area + position * unit_size, extent * unit_size);
+    }
+    return_pages(position, extent);
+}
+
+void MemoryManager::reset_stats() {
+    stats.allocations.store(0, std::memory_order_relaxed);
+    stats.frees.store(0, std::memory_order_relaxed);
+    stats.failed_allocations.store(0, std::memory_order_relaxed);
+    for (auto& size_class : stats.size_classes) size_class.store(0, std::memory_order_relaxed);
+    stats.in_use_words = 0;
+    stats.peak_words = 0;
+    for (auto& histogram : latency) histogram.reset();
+}
+
+// Sets up storage_area, from the C++ heap or as a fresh private mapping
+// Huge pages need the mapping rounded up to whole huge pages; without enough set aside it
+// falls back to normal pages with a transparent huge page hint. A growable arena maps
+// reservedBytes inaccessible and opens up only the first bytes. A NUMA node, if given, is
+// bound before any page is touched; when the kernel refuses, the storage stays unbound.
+// storage_area stays null if no memory could be had.
+void MemoryManager::acquire_storage(size_t bytes, size_t reservedBytes, const Options& options) {
+    bool growable = reservedBytes > bytes;
+    bool mapped = options.mappedStorage || growable || options.numaNode >= 0;
+    release_bytes = mapped ? options.releaseBytes : 0;
+    if (!mapped) {
+        storage_area = static_cast<uint8_t*>(::operator new[](bytes, std::align_val_t(STORAGE_ALIGNMENT)));
+        return;
+    }
+
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+    flags |= MAP_NORESERVE;
+#endif
+    page_bytes = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t length = std::max<size_t>(reservedBytes, 1);
+    void* mapping = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (options.hugePages && !growable) {
+        const size_t huge_page = 2u << 20;
+        size_t huge_length = (length + huge_page - 1) / huge_page * huge_page;
+        // Reserved up front: with MAP_NORESERVE an empty huge page pool only shows as SIGBUS on first touch
+        mapping = mmap(nullptr, huge_length, PROT_READ | PROT_WRITE, (flags & ~MAP_NORESERVE) | MAP_HUGETLB, -1, 0);
+        if (mapping != MAP_FAILED) {
+            length = huge_length;
+            page_bytes = huge_page;
+        }
+    }
+#endif
+    if (mapping == MAP_FAILED) {
+        length = (length + page_bytes - 1) / page_bytes * page_bytes;
+        mapping = mmap(nullptr, length, growable ? PROT_NONE : PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (mapping == MAP_FAILED) return;
+#ifdef MADV_HUGEPAGE
+        if (options.hugePages) madvise(mapping, length, MADV_HUGEPAGE);
+#endif
+    }
+
+    if (options.numaNode >= 0 && bindToNumaNode(mapping, length, options.numaNode)) numa_node = options.numaNode;
+
+    size_t committed = growable ? std::min(length, (bytes + page_bytes - 1) / page_bytes * page_bytes) : length;
+    if (growable && committed > 0 && mprotect(mapping, committed, PROT_READ | PROT_WRITE) != 0) {
+        munmap(mapping, length);
+        return;
+    }
+    storage_area = static_cast<uint8_t*>(mapping);
+    mapped_bytes = length;
+    committed_bytes = committed;
+}
+
+// Extends the arena towards its reserved size so that a request of words can be met
+// At least doubles it, committing more of the reservation; every backend adds the new
+// words as free space, so live blocks keep their addresses. The caller holds the lock
+// if one is needed.
+bool MemoryManager::grow_storage(size_t words) {
+    if (total_capacity >= reserved_capacity) return false;
+    size_t target = std::max(total_capacity * 2, total_capacity + 2 * words);
+    target = std::min(std::max(target, total_capacity + 1), reserved_capacity);
+
+    size_t bytes = std::min(mapped_bytes, (target * unit_size + page_bytes - 1) / page_bytes * page_bytes);
+    if (bytes > committed_bytes) {
+        if (mprotect(storage_area + committed_bytes, bytes - committed_bytes, PROT_READ | PROT_WRITE) != 0) return false;
+        committed_bytes = bytes;
+    }
+
+    size_t covered;
+    size_t added;
+    if (uses_tags()) {
+        covered = tag_heap.capacityWords();
+        tag_heap.extend(target);
+        added = tag_heap.capacityWords() - covered;
+    } else if (backend == Backend::Buddy) {
+        covered = buddy_heap.capacityWords();
+        buddy_heap.extend(target);
+        added = buddy_heap.capacityWords() - covered;
+    } else {
+        covered = total_capacity;
+        added = target - total_capacity;
+        auto last = memory_regions.empty() ? memory_regions.end() : std::prev(memory_regions.end());
+        if (last != memory_regions.end() && last->second.available) {
+            hole_index.erase({last->second.extent, last->first});
+            last->second.extent += added;
+            hole_index.emplace(last->second.extent, last->first);
         } else {
-            ++current;
+            memory_regions.emplace_hint(memory_regions.end(), covered, Region(added, true));
+            hole_index.emplace(added, covered);
         }
     }
+
+    allocation_bits.extend(target);
+    allocation_bits.clearRange(covered, added);
+    stats.in_use_words += (target - total_capacity) - added;  // Words no block covers yet
+    if (!block_classes.empty()) block_classes.resize(target, 0);  // Within the reserved capacity, so never moves
+    total_capacity.store(target, std::memory_order_release);  // Published after block_classes covers it
+    return true;
+}
+
+// Gives storage_area back to wherever it came from
+void MemoryManager::release_storage() {
+    if (persistent_fd >= 0) {
+        munmap(storage_area - PERSISTENT_HEADER_BYTES, mapped_bytes);
+        close(persistent_fd);
+        persistent_fd = -1;
+    } else if (mapped_bytes > 0) {
+        munmap(storage_area, mapped_bytes);
+    } else if (storage_area) {
+        ::operator delete[](storage_area, std::align_val_t(STORAGE_ALIGNMENT));
+    }
+    storage_area = nullptr;
+    mapped_bytes = 0;
+    committed_bytes = 0;
+    release_bytes = 0;
+    numa_node = -1;
+    persisted_clean = false;
+    restored = false;
+}
+
+// Opens options.persistentPath and maps it shared, header page first
+// A missing file is created and starts a fresh arena of sizeInWords. An existing file is
+// only used if it holds a cleanly persisted arena of this word size, long enough for the
+// capacity and block list its header gives, with every listed block inside the storage
+// and in address order: sizeInWords and the backend settings are then taken from it and
+// blocks receives its list of allocated blocks. Any other file, an arena left dirty by a
+// crash or a file that is not an arena at all, is left alone and storage_area stays null.
+// Returns whether the arena is restored.
+bool MemoryManager::map_persistent(size_t& sizeInWords, Options& options,
+                                   std::vector<std::pair<size_t, size_t>>& blocks) {
+    int fd = open(options.persistentPath, O_RDWR | O_CREAT | O_EXCL, 0644);
+    bool restoring = fd == -1;
+    if (restoring && (errno != EEXIST || (fd = open(options.persistentPath, O_RDWR)) == -1)) return false;
+
+    PersistentHeader header;
+    if (restoring && !read_arena_file(fd, unit_size, header, blocks)) {
+        close(fd);
+        return false;
+    }
+
+    if (restoring) {
+        sizeInWords = header.capacity;
+        options.backend = static_cast<Backend>(header.backend);
+        options.tlsfSecondLevelBits = static_cast<unsigned>(header.second_level_bits);
+    } else if (ftruncate(fd, block_list_offset(sizeInWords, unit_size)) != 0) {
+        close(fd);
+        unlink(options.persistentPath);
+        return false;
+    }
+
+    size_t length = PERSISTENT_HEADER_BYTES + sizeInWords * unit_size;
+    void* mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        close(fd);
+        if (!restoring) unlink(options.persistentPath);
+        return false;
+    }
+
+    storage_area = static_cast<uint8_t*>(mapping) + PERSISTENT_HEADER_BYTES;
+    mapped_bytes = length;
+    page_bytes = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    persistent_fd = fd;
+    if (!restoring) {
+        header = PersistentHeader();
+        std::memcpy(header.magic, PERSISTENT_MAGIC, sizeof(PERSISTENT_MAGIC));
+        header.word_size = unit_size;
+        header.capacity = sizeInWords;
+        header.backend = static_cast<uint64_t>(options.backend);
+        header.second_level_bits = options.tlsfSecondLevelBits;
+        header.root = npos;
+        std::memcpy(mapping, &header, sizeof(header));
+    }
+    persisted_clean = restoring;
+    return restoring;
+}
+
+// Rebuilds the backend's bookkeeping over a restored storage area
+// The tag heaps find their blocks in band; the others are handed the allocated blocks
+void MemoryManager::restore_blocks(const std::vector<std::pair<size_t, size_t>>& blocks, const Options& options) {
+    if (uses_tags()) {
+        tag_heap.adopt(storage_area, total_capacity, unit_size,
+                       backend == Backend::Tlsf ? options.tlsfSecondLevelBits : 0);
+        return;
+    }
+    if (backend == Backend::Buddy) {
+        buddy_heap.adopt(storage_area, total_capacity, unit_size, blocks);
+        return;
+    }
+
+    // Regions: the gaps between the allocated blocks, which are listed in order, are the holes
+    size_t position = 0;
+    for (const auto& block : blocks) {
+        if (block.first < position || block.first + block.second > total_capacity) continue;
+        if (block.first > position) {
+            memory_regions.emplace_hint(memory_regions.end(), position, Region(block.first - position, true));
+            hole_index.emplace(block.first - position, position);
+        }
+        memory_regions.emplace_hint(memory_regions.end(), block.first, Region(block.second, false));
+        position = block.first + block.second;
+    }
+    if (position < total_capacity) {
+        memory_regions.emplace_hint(memory_regions.end(), position, Region(total_capacity - position, true));
+        hole_index.emplace(total_capacity - position, position);
+    }
+}
+
+// Writes the block list and flushes the whole mapping, then marks the header clean
+// The caller holds the lock if one is needed
+bool MemoryManager::write_persistent_state() {
+    coalesce_deferred();
+    std::vector<std::pair<size_t, size_t>> blocks;
+    if (backend == Backend::Regions) {
+        for (const auto& region : memory_regions) {
+            if (!region.second.available) blocks.emplace_back(region.first, region.second.extent);
+        }
+    } else if (backend == Backend::Buddy) {
+        buddy_heap.forEachBlock([&](size_t position, size_t extent, bool allocated) {
+            if (allocated) blocks.emplace_back(position, extent);
+        });
+    }
+
+    PersistentHeader* header = header_of(storage_area);
+    header->clean = 0;
+    off_t list_offset = block_list_offset(total_capacity, unit_size);
+    size_t list_bytes = blocks.size() * sizeof(blocks[0]);
+    if (ftruncate(persistent_fd, list_offset + list_bytes) != 0) return false;
+    if (list_bytes > 0 && pwrite(persistent_fd, blocks.data(), list_bytes, list_offset) !=
+                              static_cast<ssize_t>(list_bytes)) {
+        return false;
+    }
+    header->block_count = blocks.size();
+    if (msync(header, mapped_bytes, MS_SYNC) != 0 || fdatasync(persistent_fd) != 0) return false;
+
+    // Only once everything it describes is on disk
+    header->clean = 1;
+    msync(header, PERSISTENT_HEADER_BYTES, MS_SYNC);
+    persisted_clean = true;
+    return true;
+}
+
+// First change after a persist(): the file no longer describes the arena
+void MemoryManager::mark_dirty() {
+    header_of(storage_area)->clean = 0;
+    persisted_clean = false;
+}
+
+// Hands the whole pages inside a large enough free hole back to the system
+// The backend's in-band bookkeeping at either end of the hole is kept resident; the rest
+// reads as zeros when touched again
+void MemoryManager::return_pages(size_t position, size_t extent) {
+    if (release_bytes == 0 || extent * unit_size < release_bytes) return;
+
+    size_t head = 0;
+    size_t tail = 0;
+    if (uses_tags()) {
+        head = (tag_heap.payloadOffset() + tag_heap.linkWords()) * unit_size;
+        tail = tag_heap.payloadOffset() * unit_size;
+    } else if (backend == Backend::Buddy) {
+        head = 2 * sizeof(size_t);
+    }
+    uintptr_t first = reinterpret_cast<uintptr_t>(storage_area + position * unit_size) + head;
+    uintptr_t last = reinterpret_cast<uintptr_t>(storage_area + (position + extent) * unit_size) - tail;
+    first = (first + page_bytes - 1) / page_bytes * page_bytes;
+    last = last / page_bytes * page_bytes;
+    if (last > first) madvise(reinterpret_cast<void*>(first), last - first, MADV_DONTNEED);
+}
+
+// Combines a free region with its free physical neighbours to prevent fragmentation
+// Regions are kept in address order, so only the entries on either side need checking
+// Returns the region that now covers the freed space
+MemoryManager::RegionMap::iterator MemoryManager::merge_adjacent_regions(RegionMap::iterator region) {
+    uint64_t started = start_timer();
+    auto next = std::next(region);
+    if (next != memory_regions.end() && next->second.available) {
+        hole_index.erase({region->second.extent, region->first});
+        hole_index.erase({next->second.extent, next->first});
+        region->second.extent += next->second.extent;  // Absorb the following region
+        hole_index.emplace(region->second.extent, region->first);
+        memory_regions.erase(next);
+    }
+
+    if (region != memory_regions.begin()) {
+        auto prev = std::prev(region);
+        if (prev->second.available) {
+            hole_index.erase({prev->second.extent, prev->first});
+            hole_index.erase({region->second.extent, region->first});
+            prev->second.extent += region->second.extent;  // Fold into the preceding region
+            hole_index.emplace(prev->second.extent, prev->first);
+            memory_regions.erase(region);
+            region = prev;
+        }
+    }
+    stop_timer(TimedOperation::Merge, started);
+    return region;
+}
+
+// Hands out a deferred region of exactly words, or nullptr if none is waiting
+// The region never left the allocated state, so nothing but its flag changes
+void* MemoryManager::reuse_deferred(size_t words) {
+    auto list = quick_lists.find(words);
+    if (list == quick_lists.end() || list->second.empty()) return nullptr;
+
+    size_t position = list->second.back();
+    list->second.pop_back();
+    deferred_count--;
+    memory_regions.find(position)->second.deferred = false;
+    return storage_area + position * unit_size;
+}
+
+// Frees every deferred region in one sorted pass that merges each run of free regions once
+// Returns whether any region was waiting; the caller holds the lock if one is needed
+bool MemoryManager::coalesce_deferred() {
+    if (deferred_count == 0) return false;
+
+    deferred_addresses.clear();
+    for (auto& list : quick_lists) {
+        for (size_t position : list.second) {
+            memory_regions.find(position)->second.deferred = false;
+            deferred_addresses.push_back(storage_area + position * unit_size);
+        }
+        list.second.clear();  // Keeps its capacity for the next round
+    }
+    deferred_count = 0;
+    std::sort(deferred_addresses.begin(), deferred_addresses.end(), std::less<void*>());
+    free_regions_sorted(deferred_addresses.data(), deferred_addresses.size());
+    return true;
+}
+
+// Finds a hole for the built-in strategies straight from hole_index in O(log n)
+// Ties are broken by lowest position, matching the getList() based strategies
+size_t MemoryManager::find_indexed_hole(size_t words) const {
+    FreeIndex index = free_index();
+    switch (strategy) {
+        case FitStrategy::WorstFit: return index.worstFit(words);
+        case FitStrategy::FirstFit: return index.firstFit(words);
+        case FitStrategy::NextFit:  return index.nextFit(words, *fit_cursor);
+        case FitStrategy::GoodFit:  return index.goodFit(words, fit_tolerance);
+        case FitStrategy::BitmapFirstFit:
+            // Buddy blocks are not coalesced, so a run of free words may span several of them
+            return (backend == Backend::Buddy) ? index.firstFit(words) : allocation_bits.findClearRun(words);
+        default:                    return index.bestFit(words);
+    }
+}
+
+// Asks a user-supplied selector for a hole; returns HoleView::npos when it finds none
+// HoleView selectors iterate the hole storage in place. The legacy selector still
+// gets the 16-bit getList() array, packed into a buffer that is reused across calls
+size_t MemoryManager::select_custom_hole(size_t words) {
+    if (strategy == FitStrategy::CustomView) return hole_selector(words, hole_view());
+
+    legacy_list.resize(hole_count() * 2 + 1);
+    pack_hole_list(legacy_list.data());
+    int chosen_offset = selector(words, legacy_list.data());
+    return (chosen_offset == -1) ? HoleView::npos : static_cast<size_t>(chosen_offset);
+}
+
+// Number of free holes, without walking them
+size_t MemoryManager::hole_count() const {
+    if (uses_tags()) return tag_heap.freeBlockCount();
+    if (backend == Backend::Buddy) return buddy_heap.freeBlockCount();
+    return hole_index.size();
+}
+
+// View over the current backend's holes
+HoleView MemoryManager::hole_view() const {
+    if (uses_tags()) return HoleView(tag_heap, hole_count());
+    if (backend == Backend::Buddy) return HoleView(buddy_heap, hole_count());
+    return HoleView(memory_regions, hole_count());
+}
+
+// Holes of the current backend, with the size index where the backend keeps one
+FreeIndex MemoryManager::free_index() const {
+    return FreeIndex(backend == Backend::Regions ? &hole_index : nullptr, hole_view());
+}
+
+// True when allocate_at() can carve straight from the region map, which needs
+// the Regions backend, no lock to take, no deferred frees to reuse first and no
+// latency to record around the policy call
+bool MemoryManager::uses_region_index() const {
+    return storage_area && backend == Backend::Regions && !concurrent && deferred_limit == 0 && !timing;
+}
+
+// Allocates words at the free hole starting at position for a request of sizeInBytes,
+// with the same counting, tracing and recording as allocate(); see uses_region_index()
+void* MemoryManager::allocate_at(size_t position, size_t words, size_t sizeInBytes) {
+    return finish_allocation(carve_region(position, words), sizeInBytes, 0);
+}
+
+// Identifies the built-in strategies so allocate() can bypass the getList() callback
+MemoryManager::FitStrategy MemoryManager::classify_selector(const std::function<int(int, void*)>& allocator) {
+    auto fn = allocator.target<int(*)(int, void*)>();
+    if (fn && *fn == bestFit) return FitStrategy::BestFit;
+    if (fn && *fn == worstFit) return FitStrategy::WorstFit;
+    if (fn && *fn == firstFit) return FitStrategy::FirstFit;
+    if (allocator.target<NextFit>()) return FitStrategy::NextFit;
+    if (allocator.target<GoodFit>()) return FitStrategy::GoodFit;
+    return FitStrategy::Custom;
+}
+
+MemoryManager::FitStrategy MemoryManager::classify_selector(const HoleSelector& allocator) {
+    auto fn = allocator.target<size_t(*)(size_t, const HoleView&)>();
+    if (fn && *fn == bestFit64) return FitStrategy::BestFit;
+    if (fn && *fn == worstFit64) return FitStrategy::WorstFit;
+    if (fn && *fn == firstFit64) return FitStrategy::FirstFit;
+    if (fn && *fn == bitmapFirstFit64) return FitStrategy::BitmapFirstFit;
+    if (allocator.target<NextFit>()) return FitStrategy::NextFit;
+    if (allocator.target<GoodFit>()) return FitStrategy::GoodFit;
+    return FitStrategy::CustomView;
+}
+
+// Points the stateful built-in strategies at the state kept in their selector object
+void MemoryManager::bind_fit_state() {
+    NextFit* next_fit = selector ? selector.target<NextFit>() : hole_selector.target<NextFit>();
+    GoodFit* good_fit = selector ? selector.target<GoodFit>() : hole_selector.target<GoodFit>();
+    fit_cursor = next_fit ? &next_fit->cursor : nullptr;
+    fit_tolerance = good_fit ? good_fit->tolerancePercent : 0;
+}
+
+// True for the backends that keep their blocks in tag_heap
+bool MemoryManager::uses_tags() const {
+    return backend == Backend::BoundaryTags || backend == Backend::Tlsf;
 }
 
 // Checks if a given memory address is within the managed memory space
+// Called without the lock in concurrent mode, while grow_storage() may raise the capacity
 bool MemoryManager::validate_address(void* addr) const {
     uint8_t* ptr = static_cast<uint8_t*>(addr);
-    return ptr >= storage_area && ptr < storage_area + (total_capacity * unit_size);
+    return ptr >= storage_area && ptr < storage_area + (total_capacity.load(std::memory_order_acquire) * unit_size);
 }
 
 // Converts byte count to word count, rounding up if necessary
@@ -44,155 +666,1141 @@ size_t MemoryManager::convert_to_words(size_t bytes) const {
     return (bytes + unit_size - 1) / unit_size;
 }
 
+// Visits every free hole in address order as visit(position, extent)
+template <typename Visitor>
+void MemoryManager::for_each_hole(Visitor visit) const {
+    if (uses_tags()) {
+        tag_heap.forEachBlock([&](size_t position, size_t extent, bool allocated) {
+            if (!allocated) visit(position, extent);
+        });
+        return;
+    }
+    if (backend == Backend::Buddy) {
+        buddy_heap.forEachBlock([&](size_t position, size_t extent, bool allocated) {
+            if (!allocated) visit(position, extent);
+        });
+        return;
+    }
+    for (const auto& region : memory_regions) {
+        if (region.second.available) visit(region.first, region.second.extent);
+    }
+}
+
 // Initializes the memory manager with a specified size
 // Creates a single free region spanning the entire memory space
 void MemoryManager::initialize(size_t sizeInWords) {
+    initialize(sizeInWords, Options());
+}
+
+// Initializes the memory manager with a specified size and backend
+// With Options::persistentPath the arena lives in that file; an arena persisted there
+// earlier is mapped back with its blocks where they were, keeping its own size and backend
+// in place of sizeInWords and options. Persistent arenas do not grow and keep no
+// per-thread caches, so that every block is accounted for in the file.
+void MemoryManager::initialize(size_t sizeInWords, const Options& requested) {
     shutdown();  // Clean up any existing allocation
-    
-    storage_area = new uint8_t[sizeInWords * unit_size];
+
+    Options options = requested;
+    std::vector<std::pair<size_t, size_t>> blocks;
+    bool restoring = false;
+    size_t reserved = std::max(sizeInWords, options.maxSizeInWords);
+    if (options.persistentPath) {
+        restoring = map_persistent(sizeInWords, options, blocks);
+        restored = restoring;
+        reserved = sizeInWords;
+        options.threadCacheLimit = 0;
+    } else {
+        acquire_storage(sizeInWords * unit_size, reserved * unit_size, options);
+    }
+    timing = options.latencyHistograms;
+    if (!storage_area) return;
     total_capacity = sizeInWords;
-    memory_regions.clear();
-    // Create initial region covering all memory, marked as available
-    memory_regions.emplace_back(0, sizeInWords, true);
-    allocation_table.clear();
+    reserved_capacity = reserved;
+    backend = options.backend;
+    debug_checks = options.debugChecks;
+    deferred_limit = (backend == Backend::Regions) ? options.deferredFrees : 0;
+    concurrent = options.concurrent;
+    thread_cache_limit = options.concurrent ? options.threadCacheLimit : 0;
+    instance_id = next_instance_id.fetch_add(1, std::memory_order_relaxed);
+    if (thread_cache_limit > 0 && (backend == Backend::Regions || backend == Backend::Buddy)) {
+        // Other threads read it without the lock, so growth must never reallocate it
+        block_classes.reserve(reserved);
+        block_classes.assign(sizeInWords, 0);
+    }
+
+    if (restoring) {
+        restore_blocks(blocks, options);
+    } else if (uses_tags()) {
+        tag_heap.reset(storage_area, sizeInWords, unit_size,
+                       backend == Backend::Tlsf ? options.tlsfSecondLevelBits : 0);
+    } else if (backend == Backend::Buddy) {
+        buddy_heap.reset(storage_area, sizeInWords, unit_size);
+    } else {
+        // Create initial region covering all memory, marked as available
+        memory_regions.emplace(0, Region(sizeInWords, true));
+        hole_index.emplace(sizeInWords, 0);
+    }
+
+    // Words no block covers, such as a buddy heap's remainder, stay allocated for good
+    allocation_bits.reset(sizeInWords);
+    reset_stats();
+    stats.in_use_words = sizeInWords;
+    for_each_hole([&](size_t position, size_t extent) {
+        allocation_bits.clearRange(position, extent);
+        stats.in_use_words -= extent;
+    });
+    stats.peak_words = stats.in_use_words;
 }
 
 // Cleans up all allocated memory and resets the manager state
+// Per-thread caches are dropped; their blocks belonged to the released storage
 void MemoryManager::shutdown() {
-    delete[] storage_area;
-    storage_area = nullptr;
+    stopRecording();  // Offsets would mean nothing against the next storage area
+    auto guard = lock_state();
+    for (auto& cache : thread_caches) {
+        cache->retired.store(true, std::memory_order_release);
+    }
+    thread_caches.clear();
+    block_classes.clear();
+    if (persistent_fd >= 0) {
+        drain_remote_frees();
+        write_persistent_state();
+    }
+    remote_frees.takeAll();
+
+    release_storage();
     total_capacity = 0;
+    reserved_capacity = 0;
     memory_regions.clear();
-    allocation_table.clear();
+    hole_index.clear();
+    quick_lists.clear();
+    deferred_count = 0;
+    tag_heap.reset(nullptr, 0, unit_size);
+    buddy_heap.reset(nullptr, 0, unit_size);
+    allocation_bits.reset(0);
+    movable_blocks.clear();
+    free_handles.clear();
+    movable_by_offset.clear();
+    compact_cursor = 0;
 }
 
 // Allocates memory of requested size using the selected allocation strategy
 void* MemoryManager::allocate(size_t sizeInBytes) {
-    if (!storage_area) return nullptr;
-    
-    size_t words_required = convert_to_words(sizeInBytes);
-    // Get list of available regions and apply allocation strategy
-    uint16_t* available_regions = static_cast<uint16_t*>(getList());
-    int chosen_offset = selector(words_required, available_regions);
-    delete[] available_regions;
-    
-    if (chosen_offset == -1) return nullptr;  // No suitable region found
+    if (!storage_area || sizeInBytes == 0) return nullptr;
+    uint64_t started = start_timer();
+    void* result = concurrent ? allocate_concurrent(sizeInBytes) : allocate_words(convert_to_words(sizeInBytes));
+    return finish_allocation(result, sizeInBytes, started);
+}
+
+// Counts, times, traces and records an allocation request of sizeInBytes that produced
+// result, nullptr if it failed; returns result
+void* MemoryManager::finish_allocation(void* result, size_t sizeInBytes, uint64_t started) {
+    count_allocation(sizeInBytes, result != nullptr);
+    stop_timer(TimedOperation::Allocate, started);
+    if (trace_hook && result) trace_hook(TraceEvent::Allocate, result, sizeInBytes);
+    if (recorder && result) recorder->recordAllocate(static_cast<uint8_t*>(result) - storage_area, sizeInBytes);
+    return result;
+}
+
+// Allocates from whichever backend manages the storage, merging deferred frees and then
+// growing a growable arena until the request fits or there is nothing left to try; the
+// caller holds the lock if one is needed
+void* MemoryManager::allocate_words(size_t words) {
+    for (;;) {
+        void* result = uses_tags() ? allocate_tagged(words)
+                     : (backend == Backend::Buddy) ? allocate_buddy(words)
+                     : allocate_region(words);
+        if (result || !(coalesce_deferred() || grow_storage(words))) return result;
+    }
+}
+
+// Allocates a region of words from the region map
+// A deferred free of exactly the size wanted is handed back out before any hole is searched
+void* MemoryManager::allocate_region(size_t words_required) {
+    if (deferred_count > 0) {
+        if (void* reused = reuse_deferred(words_required)) return reused;
+    }
+
+    // Apply the allocation strategy to the available regions
+    uint64_t started = start_timer();
+    size_t chosen_offset = (strategy == FitStrategy::Custom || strategy == FitStrategy::CustomView)
+        ? select_custom_hole(words_required)
+        : find_indexed_hole(words_required);
+    stop_timer(TimedOperation::Select, started);
     
+    if (chosen_offset == HoleView::npos) return nullptr;  // No suitable region found
+    return carve_region(chosen_offset, words_required);
+}
+
+// Marks words at the start of the free region at chosen_offset as allocated
+void* MemoryManager::carve_region(size_t chosen_offset, size_t words_required) {
     // Find the selected region in our internal tracking
-    auto region_it = std::find_if(memory_regions.begin(), memory_regions.end(),
-        [chosen_offset](const Region& r) { 
-            return r.available && r.position == static_cast<size_t>(chosen_offset);
-        });
-        
+    auto region_it = memory_regions.find(chosen_offset);
     if (region_it == memory_regions.end()) return nullptr;
+
+    Region& region = region_it->second;
+    if (!region.available || region.extent < words_required) return nullptr;
+    hole_index.erase({region.extent, region_it->first});
+    
+    // Mark region as allocated
+    region.available = false;
     
     // If the region is larger than needed, split it
-    if (region_it->extent > words_required) {
-        memory_regions.emplace_back(
-            region_it->position + words_required,
-            region_it->extent - words_required,
-            true
-        );
-        region_it->extent = words_required;
+    if (region.extent > words_required) {
+        size_t remainder_position = region_it->first + words_required;
+        size_t remainder_extent = region.extent - words_required;
+        region.extent = words_required;
+        memory_regions.emplace_hint(std::next(region_it), remainder_position, Region(remainder_extent, true));
+        hole_index.emplace(remainder_extent, remainder_position);
     }
+    mark_allocated(chosen_offset, words_required);
     
-    // Mark region as allocated and record it
-    region_it->available = false;
-    void* allocated_memory = storage_area + (chosen_offset * unit_size);
-    allocation_table[reinterpret_cast<uintptr_t>(allocated_memory)] = sizeInBytes;
-    
-    return allocated_memory;
+    return storage_area + (chosen_offset * unit_size);
+}
+
+// Allocates from the boundary-tag heap; the block extent includes its header and footer
+// The Tlsf backend answers best fit with the constant-time TLSF search, which may pass over
+// a closer fit that shares the request's size class
+void* MemoryManager::allocate_tagged(size_t words) {
+    size_t extent = tag_heap.blockExtent(words);
+    size_t position;
+    if (strategy == FitStrategy::BestFit) {
+        position = (backend == Backend::Tlsf) ? tag_heap.findGoodFit(extent) : tag_heap.findBestFit(extent);
+    } else if (strategy == FitStrategy::WorstFit) {
+        position = tag_heap.findWorstFit(extent);
+    } else if (strategy == FitStrategy::Custom || strategy == FitStrategy::CustomView) {
+        position = select_custom_hole(extent);
+    } else {
+        position = find_indexed_hole(extent);
+    }
+
+    if (position == BoundaryTagHeap::npos) return nullptr;
+    size_t carved = tag_heap.carve(position, extent);
+    if (carved == 0) return nullptr;
+    mark_allocated(position, carved);
+    return storage_area + (position + tag_heap.payloadOffset()) * unit_size;
+}
+
+// Allocates from the buddy heap; the request is rounded up to a power-of-two block
+void* MemoryManager::allocate_buddy(size_t words) {
+    size_t extent = buddy_heap.blockExtent(words);
+    size_t position;
+    if (strategy == FitStrategy::BestFit) {
+        position = buddy_heap.findBestFit(extent);
+    } else if (strategy == FitStrategy::WorstFit) {
+        position = buddy_heap.findWorstFit(extent);
+    } else if (strategy == FitStrategy::Custom || strategy == FitStrategy::CustomView) {
+        position = select_custom_hole(extent);
+    } else {
+        position = find_indexed_hole(extent);
+    }
+
+    if (position == BuddyHeap::npos) return nullptr;
+    size_t carved = buddy_heap.carve(position, extent);
+    if (carved == 0) return nullptr;
+    mark_allocated(position, carved);
+    return storage_area + position * unit_size;
+}
+
+// Allocates memory whose address is a multiple of alignment, a power of two
+// The words skipped to reach the alignment stay free as a hole of their own where the
+// backend can hold one. Buddy blocks instead grow to the alignment, which their natural
+// alignment then satisfies. Aligned blocks bypass the per-thread caches in concurrent mode.
+void* MemoryManager::allocateAligned(size_t sizeInBytes, size_t alignment) {
+    if (!storage_area || sizeInBytes == 0 || alignment == 0 || (alignment & (alignment - 1))) return nullptr;
+
+    uint64_t started = start_timer();
+    auto guard = lock_state();
+    if (concurrent) drain_remote_frees();
+
+    size_t words = convert_to_words(sizeInBytes);
+    void* result;
+    do {
+        result = uses_tags() ? allocate_aligned_tagged(words, alignment)
+               : (backend == Backend::Buddy) ? allocate_aligned_buddy(words, alignment)
+               : allocate_aligned_region(words, alignment);
+    } while (!result && (coalesce_deferred() || grow_storage(words + convert_to_words(alignment))));
+    if (result && !block_classes.empty()) block_classes[(static_cast<uint8_t*>(result) - storage_area) / unit_size] = 0;
+    return finish_allocation(result, sizeInBytes, started);
+}
+
+// First position at or after position whose payload, payloadOffset words in, is aligned
+// Word sizes that share no factor with the alignment may need several steps; npos if none works
+size_t MemoryManager::aligned_start(size_t position, size_t payloadOffset, size_t alignment) const {
+    uintptr_t base = reinterpret_cast<uintptr_t>(storage_area);
+    uintptr_t address = base + (position + payloadOffset) * unit_size;
+    address = (address + alignment - 1) & ~(uintptr_t(alignment) - 1);
+    for (unsigned step = 0; step < unit_size; ++step, address += alignment) {
+        if ((address - base) % unit_size == 0) return (address - base) / unit_size - payloadOffset;
+    }
+    return HoleView::npos;
+}
+
+// Smallest hole with room for the words after its aligned start; the lead stays a hole
+void* MemoryManager::allocate_aligned_region(size_t words, size_t alignment) {
+    for (auto it = hole_index.lower_bound({words, 0}); it != hole_index.end(); ++it) {
+        size_t hole = it->second;
+        size_t extent = it->first;
+        size_t start = aligned_start(hole, 0, alignment);
+        if (start == HoleView::npos || start - hole > extent - words) continue;
+
+        if (start > hole) {
+            // Split the lead off as a free region of its own
+            auto region_it = memory_regions.find(hole);
+            hole_index.erase(it);
+            region_it->second.extent = start - hole;
+            hole_index.emplace(start - hole, hole);
+            memory_regions.emplace_hint(std::next(region_it), start, Region(extent - (start - hole), true));
+            hole_index.emplace(extent - (start - hole), start);
+        }
+        return carve_region(start, words);
+    }
+    return nullptr;
+}
+
+// Lowest free block with room after its aligned start; a lead too short to be a free
+// block of its own pushes the start to the next aligned position
+void* MemoryManager::allocate_aligned_tagged(size_t words, size_t alignment) {
+    size_t extent = tag_heap.blockExtent(words);
+    size_t offset = tag_heap.payloadOffset();
+    for (const Hole& hole : hole_view()) {
+        if (hole.extent < extent) continue;
+        size_t start = aligned_start(hole.position, offset, alignment);
+        if (start != hole.position && start != HoleView::npos && start - hole.position < tag_heap.minExtent()) {
+            start = aligned_start(hole.position + tag_heap.minExtent(), offset, alignment);
+        }
+        if (start == HoleView::npos || start - hole.position > hole.extent - extent) continue;
+
+        if (start > hole.position) tag_heap.splitFront(hole.position, start - hole.position);
+        size_t carved = tag_heap.carve(start, extent);
+        if (carved == 0) return nullptr;
+        mark_allocated(start, carved);
+        return storage_area + (start + offset) * unit_size;
+    }
+    return nullptr;
+}
+
+// Buddy blocks are aligned to their size, so the block is sized up to the alignment
+// and the first free block of that order or above whose address is aligned is taken
+void* MemoryManager::allocate_aligned_buddy(size_t words, size_t alignment) {
+    size_t extent = buddy_heap.blockExtent(std::max(words, convert_to_words(alignment)));
+    for (const Hole& hole : hole_view()) {
+        if (hole.extent < extent || aligned_start(hole.position, 0, alignment) != hole.position) continue;
+        size_t carved = buddy_heap.carve(hole.position, extent);
+        if (carved == 0) return nullptr;
+        mark_allocated(hole.position, carved);
+        return storage_area + hole.position * unit_size;
+    }
+    return nullptr;
 }
 
 // Frees previously allocated memory
 void MemoryManager::free(void* address) {
     if (!address || !validate_address(address)) return;
-    
-    uintptr_t addr_key = reinterpret_cast<uintptr_t>(address);
-    auto alloc_it = allocation_table.find(addr_key);
-    if (alloc_it == allocation_table.end()) return;  // Address not allocated
-    
+#if MEMORY_MANAGER_STATS
+    bump(stats.frees);
+#endif
+    if (trace_hook) {
+        size_t words;
+        {
+            auto guard = lock_state();
+            words = block_words(address);
+        }
+        if (words > 0) trace_hook(TraceEvent::Free, address, words * unit_size);
+    }
+    if (recorder) recorder->recordFree(static_cast<uint8_t*>(address) - storage_area);
+    uint64_t started = start_timer();
+    if (concurrent) {
+        free_concurrent(address);
+    } else {
+        release(address);
+    }
+    stop_timer(TimedOperation::Free, started);
+}
+
+// Payload words of the allocated block at address, or 0 if none starts there
+// The caller holds the lock if one is needed
+size_t MemoryManager::block_words(void* address) const {
+    size_t byte_offset = static_cast<uint8_t*>(address) - storage_area;
+    if (byte_offset % unit_size != 0) return 0;
+    size_t offset = byte_offset / unit_size;
+
+    if (uses_tags()) {
+        if (offset < tag_heap.payloadOffset()) return 0;
+        size_t position = offset - tag_heap.payloadOffset();
+        return tag_heap.holdsAllocatedBlock(position) ? tag_heap.extentAt(position) - 2 * tag_heap.payloadOffset() : 0;
+    }
+    if (backend == Backend::Buddy) {
+        if (offset >= buddy_heap.capacityWords()) return 0;
+        size_t extent = buddy_heap.extentAt(offset);
+        return (extent > 0 && buddy_heap.allocatedAt(offset)) ? extent : 0;
+    }
+    auto region_it = memory_regions.find(offset);
+    return (region_it == memory_regions.end() || region_it->second.available) ? 0 : region_it->second.extent;
+}
+
+// Returns a block to whichever backend manages the storage; the caller holds the lock if one is needed
+void MemoryManager::release(void* address) {
+    if (uses_tags()) {
+        free_tagged(address);
+    } else if (backend == Backend::Buddy) {
+        free_buddy(address);
+    } else {
+        free_region(address);
+    }
+}
+
+// Frees a region and merges it with its free neighbours
+void MemoryManager::free_region(void* address) {
     // Calculate offset in words from start of storage
     size_t offset = (static_cast<uint8_t*>(address) - storage_area) / unit_size;
     
-    // Find the corresponding region
-    auto region_it = std::find_if(memory_regions.begin(), memory_regions.end(),
-        [offset](const Region& r) { return r.position == offset && !r.available; });
-        
-    if (region_it != memory_regions.end()) {
-        region_it->available = true;
-        allocation_table.erase(alloc_it);
-        merge_adjacent_regions();  // Combine with any adjacent free regions
+    // Find the corresponding region; addresses that do not start an allocated region are ignored
+    auto region_it = memory_regions.find(offset);
+    if (region_it == memory_regions.end() || region_it->second.available || region_it->second.deferred) return;
+
+    if (deferred_limit > 0) {
+        // Held back for reuse; merged with the others once enough have piled up
+        region_it->second.deferred = true;
+        quick_lists[region_it->second.extent].push_back(offset);
+        if (++deferred_count >= deferred_limit) coalesce_deferred();
+        return;
+    }
+    return_region(region_it);
+}
+
+// Makes an allocated region a hole at once, deferred frees or not, and merges it with its
+// free neighbours
+void MemoryManager::return_region(RegionMap::iterator region_it) {
+    region_it->second.available = true;
+    hole_index.emplace(region_it->second.extent, region_it->first);
+    mark_free(region_it->first, region_it->second.extent);
+    size_t released = region_it->second.extent;
+    auto hole = merge_adjacent_regions(region_it);  // Combine with any adjacent free regions
+    settle_hole(hole->first, hole->second.extent, released);
+}
+
+// Frees a boundary-tag block; its header sits just before the address
+// Without debug checks the address is trusted to come from allocate()
+void MemoryManager::free_tagged(void* address) {
+    size_t byte_offset = static_cast<uint8_t*>(address) - storage_area;
+    size_t offset = byte_offset / unit_size;
+    if (debug_checks && (byte_offset % unit_size != 0 || offset < tag_heap.payloadOffset())) return;
+
+    size_t position = offset - tag_heap.payloadOffset();
+    size_t hole_position = 0;
+    size_t hole_extent = 0;
+    size_t released = tag_heap.release(position, debug_checks, &hole_position, &hole_extent);
+    mark_free(position, released);
+    settle_hole(hole_position, hole_extent, released);
+}
+
+// Frees a buddy block; addresses that do not start an allocated block are ignored
+void MemoryManager::free_buddy(void* address) {
+    size_t byte_offset = static_cast<uint8_t*>(address) - storage_area;
+    if (byte_offset % unit_size != 0) return;
+
+    size_t position = byte_offset / unit_size;
+    size_t hole_position = 0;
+    size_t hole_extent = 0;
+    size_t released = buddy_heap.release(position, &hole_position, &hole_extent);
+    mark_free(position, released);
+    settle_hole(hole_position, hole_extent, released);
+}
+
+// Allocates count blocks under a single lock; out[i] receives the block for sizes[i]
+// Requests that cannot be met get nullptr. Returns the number of blocks allocated.
+// Batched blocks bypass the per-thread caches in concurrent mode. Each block is traced
+// like one from allocate(); the whole batch is a single Allocate latency sample.
+size_t MemoryManager::allocateBatch(const size_t* sizes, void** out, size_t count) {
+    uint64_t started = start_timer();
+    auto guard = lock_state();
+    if (concurrent) drain_remote_frees();
+
+    size_t allocated = 0;
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = (storage_area && sizes[i] > 0) ? allocate_words(convert_to_words(sizes[i])) : nullptr;
+        if (storage_area && sizes[i] > 0) count_allocation(sizes[i], out[i] != nullptr);
+        if (!out[i]) continue;
+        if (trace_hook) trace_hook(TraceEvent::Allocate, out[i], sizes[i]);
+        if (recorder) recorder->recordAllocate(static_cast<uint8_t*>(out[i]) - storage_area, sizes[i]);
+        if (!block_classes.empty()) block_classes[(static_cast<uint8_t*>(out[i]) - storage_area) / unit_size] = 0;
+        allocated++;
+    }
+    stop_timer(TimedOperation::Allocate, started);
+    return allocated;
+}
+
+// Frees count blocks under a single lock; null and foreign addresses are skipped
+// On the Regions backend addresses is sorted in place so the freed regions are
+// coalesced in one pass over the span they cover, rather than one merge per block.
+// Each block is traced like one passed to free(); the whole batch is a single Free
+// latency sample.
+void MemoryManager::freeBatch(void** addresses, size_t count) {
+    uint64_t started = start_timer();
+    auto guard = lock_state();
+    if (!storage_area) return;
+    if (concurrent) drain_remote_frees();
+
+#if MEMORY_MANAGER_STATS
+    size_t inside = 0;
+    for (size_t i = 0; i < count; ++i) inside += (addresses[i] && validate_address(addresses[i])) ? 1 : 0;
+    bump(stats.frees, inside);
+#endif
+    if (trace_hook || recorder) {
+        for (size_t i = 0; i < count; ++i) {
+            if (!addresses[i] || !validate_address(addresses[i])) continue;
+            size_t words = trace_hook ? block_words(addresses[i]) : 0;
+            if (words > 0) trace_hook(TraceEvent::Free, addresses[i], words * unit_size);
+            if (recorder) recorder->recordFree(static_cast<uint8_t*>(addresses[i]) - storage_area);
+        }
+    }
+    if (backend == Backend::Regions) {
+        std::sort(addresses, addresses + count, std::less<void*>());
+        free_regions_sorted(addresses, count);
+    } else {
+        for (size_t i = 0; i < count; ++i) {
+            if (addresses[i] && validate_address(addresses[i])) release(addresses[i]);
+        }
+    }
+    stop_timer(TimedOperation::Free, started);
+}
+
+// Marks the regions at the sorted addresses free, then merges every run of free regions
+// from the first freed region's predecessor to the last one's successor
+// The merge pass is timed as one Merge, standing in for the per-free merges it replaces
+void MemoryManager::free_regions_sorted(void** addresses, size_t count) {
+    auto first = memory_regions.end();
+    size_t last_position = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (!addresses[i] || !validate_address(addresses[i])) continue;
+        size_t byte_offset = static_cast<uint8_t*>(addresses[i]) - storage_area;
+        auto region_it = memory_regions.find(byte_offset / unit_size);
+        if (region_it == memory_regions.end() || region_it->second.available || region_it->second.deferred) continue;
+
+        region_it->second.available = true;
+        mark_free(region_it->first, region_it->second.extent);
+        if (first == memory_regions.end()) first = region_it;
+        last_position = region_it->first;
+    }
+    if (first == memory_regions.end()) return;
+
+    // Holes already present are in hole_index and leave it when merged; freed regions never entered it
+    uint64_t started = start_timer();
+    auto region = (first != memory_regions.begin() && std::prev(first)->second.available) ? std::prev(first) : first;
+    while (region != memory_regions.end() && region->first <= last_position) {
+        if (!region->second.available) {
+            ++region;
+            continue;
+        }
+        hole_index.erase({region->second.extent, region->first});
+        size_t before = region->second.extent;
+        for (auto next = std::next(region); next != memory_regions.end() && next->second.available;
+             next = memory_regions.erase(next)) {
+            hole_index.erase({next->second.extent, next->first});
+            region->second.extent += next->second.extent;
+        }
+        hole_index.emplace(region->second.extent, region->first);
+        settle_hole(region->first, region->second.extent, before);
+        ++region;
+    }
+    stop_timer(TimedOperation::Merge, started);
+}
+
+// Resizes an allocated block, in place when the backend can, like realloc()
+// A null address allocates and a zero size frees. Otherwise the block grows into a
+// free physical successor or shrinks by handing its tail back, and is only moved,
+// keeping its contents, when neither is possible. Returns nullptr, leaving the block
+// untouched, if it cannot be moved either or address is not an allocated block.
+// A block resized in place is traced and recorded as freed and allocated again at the
+// same address, so a replay of the log sees its new size.
+void* MemoryManager::reallocate(void* address, size_t sizeInBytes) {
+    if (!address) return allocate(sizeInBytes);
+    if (sizeInBytes == 0) {
+        free(address);
+        return nullptr;
+    }
+    if (!storage_area || !validate_address(address)) return nullptr;
+
+    size_t old_words;
+    bool resized;
+    {
+        auto guard = lock_state();
+        if (concurrent) drain_remote_frees();  // Frees still in flight may be the space needed
+        resized = resize_in_place(address, convert_to_words(sizeInBytes), old_words);
+    }
+    if (resized) {
+        if (trace_hook) {
+            trace_hook(TraceEvent::Free, address, old_words * unit_size);
+            trace_hook(TraceEvent::Allocate, address, sizeInBytes);
+        }
+        if (recorder) {
+            recorder->recordFree(static_cast<uint8_t*>(address) - storage_area);
+            recorder->recordAllocate(static_cast<uint8_t*>(address) - storage_area, sizeInBytes);
+        }
+        return address;
+    }
+    if (old_words == 0) return nullptr;
+
+    void* moved = allocate(sizeInBytes);
+    if (!moved) return nullptr;
+    std::memcpy(moved, address, std::min(old_words * unit_size, sizeInBytes));
+    free(address);
+    return moved;
+}
+
+// Resizes the block at address without moving it; the caller holds the lock if one is needed
+// old_words is set to the payload the block held, or 0 when address is not an allocated block
+bool MemoryManager::resize_in_place(void* address, size_t words, size_t& old_words) {
+    old_words = 0;
+    if (uses_tags()) return resize_tagged(address, words, old_words);
+    if (backend == Backend::Buddy) return resize_buddy(address, words, old_words);
+
+    size_t byte_offset = static_cast<uint8_t*>(address) - storage_area;
+    if (byte_offset % unit_size != 0) return false;
+    return resize_region(byte_offset / unit_size, words, old_words);
+}
+
+// Shrinks a region by splitting off its tail, or grows it into a free successor
+// A region waiting on the deferred list has already been freed, so it is rejected like
+// any other address that is not an allocated block
+bool MemoryManager::resize_region(size_t offset, size_t words, size_t& old_words) {
+    auto region_it = memory_regions.find(offset);
+    if (region_it == memory_regions.end() || region_it->second.available || region_it->second.deferred) return false;
+
+    Region& region = region_it->second;
+    old_words = region.extent;
+    if (words < region.extent) {
+        size_t tail_position = offset + words;
+        size_t tail_extent = region.extent - words;
+        region.extent = words;
+        auto tail_it = memory_regions.emplace_hint(std::next(region_it), tail_position, Region(tail_extent, true));
+        hole_index.emplace(tail_extent, tail_position);
+        mark_free(tail_position, tail_extent);
+        auto hole = merge_adjacent_regions(tail_it);
+        settle_hole(hole->first, hole->second.extent, tail_extent);
+    } else if (words > region.extent) {
+        auto next = std::next(region_it);
+        size_t needed = words - region.extent;
+        if (next == memory_regions.end() || !next->second.available || next->second.extent < needed) return false;
+
+        size_t spare = next->second.extent - needed;
+        hole_index.erase({next->second.extent, next->first});
+        memory_regions.erase(next);
+        if (spare > 0) {
+            memory_regions.emplace_hint(std::next(region_it), offset + words, Region(spare, true));
+            hole_index.emplace(spare, offset + words);
+        }
+        mark_allocated(offset + region.extent, needed);
+        region.extent = words;
+    }
+
+    // The block no longer matches the class it was cached under
+    if (!block_classes.empty()) block_classes[offset] = 0;
+    return true;
+}
+
+// Resizes a boundary-tag block; the extent of a shrunk block may keep a few spare words
+bool MemoryManager::resize_tagged(void* address, size_t words, size_t& old_words) {
+    size_t byte_offset = static_cast<uint8_t*>(address) - storage_area;
+    size_t offset = byte_offset / unit_size;
+    if (byte_offset % unit_size != 0 || offset < tag_heap.payloadOffset()) return false;
+    size_t position = offset - tag_heap.payloadOffset();
+    if (debug_checks && !tag_heap.holdsAllocatedBlock(position)) return false;
+
+    size_t extent = tag_heap.extentAt(position);
+    old_words = extent - 2 * tag_heap.payloadOffset();
+    size_t resized = tag_heap.resize(position, tag_heap.blockExtent(words));
+    if (resized == 0) return false;
+    if (resized > extent) mark_allocated(position + extent, resized - extent);
+    if (resized < extent) mark_free(position + resized, extent - resized);
+    return true;
+}
+
+// Resizes a buddy block by splitting it or merging it with its free buddies
+bool MemoryManager::resize_buddy(void* address, size_t words, size_t& old_words) {
+    size_t byte_offset = static_cast<uint8_t*>(address) - storage_area;
+    if (byte_offset % unit_size != 0) return false;
+    size_t position = byte_offset / unit_size;
+    size_t extent = buddy_heap.extentAt(position);
+    if (extent == 0 || !buddy_heap.allocatedAt(position)) return false;
+
+    old_words = extent;
+    size_t resized = buddy_heap.resize(position, buddy_heap.blockExtent(words));
+    if (resized == 0) return false;
+    if (resized > extent) mark_allocated(position + extent, resized - extent);
+    if (resized < extent) mark_free(position + resized, extent - resized);
+    if (!block_classes.empty()) block_classes[position] = 0;
+    return true;
+}
+
+// Allocates a block that compact() may move to close up the free space
+// The block is reached through its handle: pin() gives its address and keeps it there until
+// unpin(). Movable blocks bypass the per-thread caches in concurrent mode, and the handle
+// table is not kept in a persistent arena's file.
+MemoryManager::MovableHandle MemoryManager::allocateMovable(size_t sizeInBytes) {
+    if (!storage_area || sizeInBytes == 0) return MovableHandle();
+
+    auto guard = lock_state();
+    if (concurrent) drain_remote_frees();
+    void* result = allocate_words(convert_to_words(sizeInBytes));
+    count_allocation(sizeInBytes, result != nullptr);
+    if (!result) return MovableHandle();
+
+    size_t offset = (static_cast<uint8_t*>(result) - storage_area) / unit_size;
+    if (!block_classes.empty()) block_classes[offset] = 0;
+    if (trace_hook) trace_hook(TraceEvent::Allocate, result, sizeInBytes);
+    if (recorder) recorder->recordAllocate(offset * unit_size, sizeInBytes);
+
+    MovableHandle handle;
+    if (free_handles.empty()) {
+        handle.index = movable_blocks.size();
+        movable_blocks.push_back({offset, sizeInBytes, 0});
+    } else {
+        handle.index = free_handles.back();
+        free_handles.pop_back();
+        movable_blocks[handle.index] = {offset, sizeInBytes, 0};
+    }
+    movable_by_offset.emplace(offset, handle.index);
+    return handle;
+}
+
+// Frees a movable block, pinned or not; the handle may be reused by a later allocateMovable()
+void MemoryManager::freeMovable(MovableHandle handle) {
+    auto guard = lock_state();
+    if (handle.index >= movable_blocks.size() || movable_blocks[handle.index].offset == npos) return;
+
+    MovableBlock& block = movable_blocks[handle.index];
+    void* address = storage_area + block.offset * unit_size;
+#if MEMORY_MANAGER_STATS
+    bump(stats.frees);
+#endif
+    if (trace_hook) trace_hook(TraceEvent::Free, address, block_words(address) * unit_size);
+    if (recorder) recorder->recordFree(block.offset * unit_size);
+    release(address);
+    movable_by_offset.erase(block.offset);
+    block.offset = npos;
+    free_handles.push_back(handle.index);
+}
+
+// Address of a movable block; compact() leaves it in place until every pin is matched by an unpin
+void* MemoryManager::pin(MovableHandle handle) {
+    auto guard = lock_state();
+    if (handle.index >= movable_blocks.size() || movable_blocks[handle.index].offset == npos) return nullptr;
+    movable_blocks[handle.index].pins++;
+    return storage_area + movable_blocks[handle.index].offset * unit_size;
+}
+
+void MemoryManager::unpin(MovableHandle handle) {
+    auto guard = lock_state();
+    if (handle.index >= movable_blocks.size()) return;
+    MovableBlock& block = movable_blocks[handle.index];
+    if (block.offset != npos && block.pins > 0) block.pins--;
+}
+
+// Moves unpinned movable blocks towards the start of the storage, a slice at a time
+// Each block is moved into the lowest hole below it that can hold it, or on the Regions
+// backend slid down over the hole just before it, so the free space gathers into a tail
+// past the last block that cannot move. A call stops once it has copied budgetBytes, or
+// has visited every movable block; the next call resumes where it stopped. Returns the
+// bytes moved, 0 when no movable block can move.
+size_t MemoryManager::compact(size_t budgetBytes) {
+    auto guard = lock_state();
+    if (!storage_area) return 0;
+    if (concurrent) drain_remote_frees();
+    coalesce_deferred();  // Deferred frees are holes for the blocks to move into
+
+    size_t moved = 0;
+    size_t visits = movable_by_offset.size();
+    auto it = movable_by_offset.lower_bound(compact_cursor);
+    for (; visits > 0 && moved < budgetBytes; --visits) {
+        if (it == movable_by_offset.end()) it = movable_by_offset.begin();
+        auto next = std::next(it);
+        size_t handle = it->second;
+        MovableBlock& block = movable_blocks[handle];
+        if (block.pins == 0) {
+            size_t offset = move_block(it->first, block);
+            if (offset == npos && backend == Backend::Regions) offset = slide_region(it->first, block);
+            if (offset != npos) {
+                if (trace_hook) {
+                    trace_hook(TraceEvent::Free, storage_area + block.offset * unit_size, block.bytes);
+                    trace_hook(TraceEvent::Allocate, storage_area + offset * unit_size, block.bytes);
+                }
+                if (recorder) {
+                    recorder->recordFree(block.offset * unit_size);
+                    recorder->recordAllocate(offset * unit_size, block.bytes);
+                }
+                movable_by_offset.erase(it);
+                movable_by_offset.emplace(offset, handle);
+                block.offset = offset;
+                moved += block.bytes;
+            }
+        }
+        it = next;
+    }
+    compact_cursor = (it == movable_by_offset.end()) ? 0 : it->first;
+    return moved;
+}
+
+// Allocates words at the start of the free hole at position, on any backend
+// The caller holds the lock if one is needed
+void* MemoryManager::carve_hole(size_t position, size_t words) {
+    if (backend == Backend::Regions) return carve_region(position, words);
+
+    size_t extent = uses_tags() ? tag_heap.blockExtent(words) : buddy_heap.blockExtent(words);
+    size_t carved = uses_tags() ? tag_heap.carve(position, extent) : buddy_heap.carve(position, extent);
+    if (carved == 0) return nullptr;
+    mark_allocated(position, carved);
+    return storage_area + (position + (uses_tags() ? tag_heap.payloadOffset() : 0)) * unit_size;
+}
+
+// Copies the movable block at offset into the lowest hole before it that holds it whole
+// Returns the block's new offset, or npos if no such hole exists
+size_t MemoryManager::move_block(size_t offset, const MovableBlock& block) {
+    size_t words = convert_to_words(block.bytes);
+    size_t start = offset;
+    size_t extent = words;
+    if (uses_tags()) {
+        start = offset - tag_heap.payloadOffset();
+        extent = tag_heap.blockExtent(words);
+    } else if (backend == Backend::Buddy) {
+        extent = buddy_heap.blockExtent(words);
+    }
+
+    for (const Hole& hole : hole_view()) {
+        if (hole.position >= start) break;
+        if (hole.extent < extent) continue;
+
+        void* target = carve_hole(hole.position, words);
+        if (!target) return npos;
+        void* source = storage_area + offset * unit_size;
+        std::memcpy(target, source, block.bytes);
+        if (backend == Backend::Regions) {
+            return_region(memory_regions.find(offset));  // Not deferred: the blocks after it move into the space
+        } else {
+            release(source);
+        }
+        size_t moved = (static_cast<uint8_t*>(target) - storage_area) / unit_size;
+        if (!block_classes.empty()) block_classes[moved] = 0;
+        return moved;
+    }
+    return npos;
+}
+
+// Slides a region down over the free region just before it, which is too small to take
+// it whole; the hole moves up past the region and merges with whatever follows
+// Returns the region's new offset, or npos if the region before it is not free
+size_t MemoryManager::slide_region(size_t offset, const MovableBlock& block) {
+    auto region_it = memory_regions.find(offset);
+    if (region_it == memory_regions.end() || region_it == memory_regions.begin()) return npos;
+    auto hole_it = std::prev(region_it);
+    if (!hole_it->second.available) return npos;
+
+    size_t position = hole_it->first;
+    size_t gap = hole_it->second.extent;
+    size_t extent = region_it->second.extent;
+    std::memmove(storage_area + position * unit_size, storage_area + offset * unit_size, block.bytes);
+
+    hole_index.erase({gap, position});
+    hole_it->second = Region(extent, false);
+    memory_regions.erase(region_it);
+    auto moved_hole = memory_regions.emplace(position + extent, Region(gap, true)).first;
+    hole_index.emplace(gap, position + extent);
+    mark_free(offset, extent);
+    mark_allocated(position, extent);
+    if (!block_classes.empty()) block_classes[position] = 0;
+    auto hole = merge_adjacent_regions(moved_hole);
+    settle_hole(hole->first, hole->second.extent, gap);
+    return position;
+}
+
+// Serializes access to the manager state in concurrent mode; a no-op otherwise
+std::unique_lock<std::mutex> MemoryManager::lock_state() {
+    return concurrent ? std::unique_lock<std::mutex>(state_lock) : std::unique_lock<std::mutex>();
+}
+
+// Finds, or creates on first use, the calling thread's cache for this manager
+ThreadCache* MemoryManager::local_cache() {
+    auto& entries = cache_slots.entries;
+    for (auto& entry : entries) {
+        if (entry.first == instance_id) return entry.second.get();
+    }
+
+    // Forget caches of managers that have since shut down
+    entries.erase(std::remove_if(entries.begin(), entries.end(), [](const auto& entry) {
+        return entry.second->retired.load(std::memory_order_acquire);
+    }), entries.end());
+
+    auto cache = std::make_shared<ThreadCache>();
+    {
+        std::lock_guard<std::mutex> guard(state_lock);
+        thread_caches.push_back(cache);
+    }
+    entries.emplace_back(instance_id, cache);
+    return cache.get();
+}
+
+// Cache class of an allocated block, without touching the shared structures
+// Returns 0 for blocks that are not small enough to be cached. The buddy tree is
+// rewritten under the lock, so Buddy blocks are looked up in block_classes too.
+size_t MemoryManager::cache_class_of(void* address) const {
+    size_t byte_offset = static_cast<uint8_t*>(address) - storage_area;
+    if (byte_offset % unit_size != 0) return 0;
+
+    size_t offset = byte_offset / unit_size;
+    if (backend == Backend::Regions || backend == Backend::Buddy) return block_classes[offset];
+    if (offset < tag_heap.payloadOffset()) return 0;
+    size_t extent = tag_heap.extentAt(offset - tag_heap.payloadOffset());
+    return extent <= ThreadCache::MAX_BLOCK_WORDS ? extent : 0;
+}
+
+// Serves small requests from the calling thread's cache, refilling it in one batch under the lock
+void* MemoryManager::allocate_concurrent(size_t sizeInBytes) {
+    // Cached blocks are linked through their first bytes, so they must hold a pointer
+    size_t words = convert_to_words(std::max(sizeInBytes, sizeof(void*)));
+    // The lock is not held yet, so the Buddy class must not depend on the tree's depth
+    size_t size_class = uses_tags() ? tag_heap.blockExtent(words)
+                      : (backend == Backend::Buddy) ? buddy_heap.classExtent(words) : words;
+    bool cacheable = thread_cache_limit > 0 && !debug_checks && size_class <= ThreadCache::MAX_BLOCK_WORDS;
+
+    ThreadCache* cache = nullptr;
+    if (cacheable) {
+        cache = local_cache();
+        if (void* block = cache->pop(size_class)) return block;
+    }
+
+    std::lock_guard<std::mutex> guard(state_lock);
+    reclaim_orphaned_caches();
+    drain_remote_frees();
+    void* result = allocate_words(words);
+    if (!result && cache) {
+        // Blocks parked in this thread's other classes may be what is missing
+        flush_cache(*cache);
+        result = allocate_words(words);
+    }
+    if (!block_classes.empty()) {
+        if (result) block_classes[(static_cast<uint8_t*>(result) - storage_area) / unit_size] = cacheable ? size_class : 0;
+    }
+    if (!result || !cache) return result;
+
+    size_t batch = std::max<size_t>(1, thread_cache_limit / 2);
+    for (size_t i = 1; i < batch; ++i) {
+        void* extra = allocate_words(words);
+        if (!extra) break;
+        if (!block_classes.empty()) block_classes[(static_cast<uint8_t*>(extra) - storage_area) / unit_size] = size_class;
+        cache->push(size_class, extra);
+    }
+    return result;
+}
+
+// Parks small blocks in the calling thread's cache, returning half of a class once it overflows
+// Blocks headed for the shared structures never wait for the lock: if it is busy they go on
+// the remote free list for the lock holder to release
+void MemoryManager::free_concurrent(void* address) {
+    if (debug_checks) {
+        // Addresses must be validated before anything is written into them
+        std::lock_guard<std::mutex> guard(state_lock);
+        drain_remote_frees();
+        release(address);
+        return;
+    }
+
+    size_t size_class = (thread_cache_limit > 0) ? cache_class_of(address) : 0;
+    if (size_class == 0) {
+        std::unique_lock<std::mutex> guard(state_lock, std::try_to_lock);
+        if (!guard.owns_lock()) {
+            remote_frees.push(address);
+            return;
+        }
+        drain_remote_frees();
+        release(address);
+        return;
+    }
+
+    ThreadCache* cache = local_cache();
+    cache->push(size_class, address);
+    if (cache->count(size_class) <= thread_cache_limit) return;
+
+    std::unique_lock<std::mutex> guard(state_lock, std::try_to_lock);
+    if (guard.owns_lock()) {
+        drain_remote_frees();
+        drain_cache(*cache, size_class, thread_cache_limit / 2);
+        return;
+    }
+
+    // Relink the surplus into a chain and hand it over with one CAS
+    void* chain = nullptr;
+    void* tail = nullptr;
+    while (cache->count(size_class) > thread_cache_limit / 2) {
+        void* block = cache->pop(size_class);
+        std::memcpy(block, &chain, sizeof(void*));
+        if (!tail) tail = block;
+        chain = block;
+    }
+    remote_frees.pushChain(chain, tail);
+}
+
+// Releases cached blocks of one class until keep remain; the caller holds the lock
+void MemoryManager::drain_cache(ThreadCache& cache, size_t size_class, size_t keep) {
+    while (cache.count(size_class) > keep) {
+        release(cache.pop(size_class));
+    }
+}
+
+// Releases every cached block; the caller holds the lock
+void MemoryManager::flush_cache(ThreadCache& cache) {
+    for (size_t size_class = 1; size_class <= ThreadCache::MAX_BLOCK_WORDS; ++size_class) {
+        drain_cache(cache, size_class, 0);
+    }
+}
+
+// Releases every block other threads pushed while the lock was busy; the caller holds the lock
+void MemoryManager::drain_remote_frees() {
+    for (void* block = remote_frees.takeAll(); block;) {
+        void* following = RemoteFreeList::next(block);
+        release(block);
+        block = following;
+    }
+}
+
+// Takes back the blocks of threads that have exited; the caller holds the lock
+void MemoryManager::reclaim_orphaned_caches() {
+    for (auto it = thread_caches.begin(); it != thread_caches.end();) {
+        if ((*it)->orphaned.load(std::memory_order_acquire)) {
+            flush_cache(**it);
+            it = thread_caches.erase(it);
+        } else {
+            ++it;
+        }
     }
 }
 
 // Changes the allocation strategy
 void MemoryManager::setAllocator(std::function<int(int, void*)> allocator) {
+    auto guard = lock_state();
     selector = allocator;
+    hole_selector = nullptr;
+    strategy = classify_selector(allocator);
+    bind_fit_state();
+}
+
+void MemoryManager::setAllocator(HoleSelector allocator) {
+    auto guard = lock_state();
+    hole_selector = allocator;
+    selector = nullptr;
+    strategy = classify_selector(allocator);
+    bind_fit_state();
 }
 
 // Creates a text file showing the current memory map
 // Format: [start, size] for each free region
 int MemoryManager::dumpMemoryMap(char* filename) {
-    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0777);
-    if (fd == -1) return -1;
-
-    // Collect and sort holes by position
+    // Copy the holes, already in position order, and format them once the lock is gone
     std::vector<std::pair<size_t, size_t>> holes;
-    for (const auto& region : memory_regions) {
-        if (region.available) {
-            holes.emplace_back(region.position, region.extent);
-        }
+    {
+        auto guard = lock_state();
+        if (concurrent) drain_remote_frees();
+        holes.reserve(hole_count());
+        for_each_hole([&](size_t position, size_t extent) { holes.emplace_back(position, extent); });
     }
-    std::sort(holes.begin(), holes.end());
 
+    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0777);
+    if (fd == -1) return -1;
+
+    // "[position, extent]" with " - " between holes, built whole and written in one go
+    std::string text;
     if (holes.empty()) {
-        const char* msg = "No holes";
-        write(fd, msg, strlen(msg));
+        text = "No holes";
     } else {
-        char buffer[32];
-        bool first = true;
-
-        for (const auto& hole : holes) {
-            if (!first) write(fd, " - ", 3);
-            
-            write(fd, "[", 1);
-            int len = snprintf(buffer, sizeof(buffer), "%lu", hole.first);
-            write(fd, buffer, len);
-            write(fd, ", ", 2);
-            len = snprintf(buffer, sizeof(buffer), "%lu", hole.second);
-            write(fd, buffer, len);
-            write(fd, "]", 1);
-            
-            first = false;
+        text.resize(holes.size() * 47);  // Two 20-digit numbers and the punctuation
+        char* out = &text[0];
+        for (size_t i = 0; i < holes.size(); ++i) {
+            if (i > 0) out = std::copy_n(" - ", 3, out);
+            *out++ = '[';
+            out = std::to_chars(out, out + 20, holes[i].first).ptr;
+            out = std::copy_n(", ", 2, out);
+            out = std::to_chars(out, out + 20, holes[i].second).ptr;
+            *out++ = ']';
         }
+        text.resize(out - text.data());
     }
 
+    iovec part = {&text[0], text.size()};
+    bool written = write_all(fd, &part, 1);
     close(fd);
-    return 0;
+    return written ? 0 : -1;
+}
+
+// Writes a binary snapshot of the holes and the allocation bitmap
+// Both are copied under the lock and written after it is released, so the file is a
+// consistent picture that does not hold up allocations while it is written.
+// Layout, integers little-endian:
+//   "MMSNAP01"   magic
+//   u64          word size in bytes
+//   u64          capacity in words
+//   u64          hole count n
+//   n x u64 u64  position and extent of each hole, in words, in position order
+//   bitmap       (capacity + 7) / 8 bytes, bit i of byte b set when word 8b + i is allocated
+// Returns 0, or -1 if the file cannot be written.
+int MemoryManager::dumpSnapshot(char* filename) {
+    std::vector<uint8_t> head;
+    std::vector<uint8_t> bitmap;
+    {
+        auto guard = lock_state();
+        if (concurrent) drain_remote_frees();
+        size_t holes = hole_count();
+        head.reserve(32 + 16 * holes);
+        head.insert(head.end(), {'M', 'M', 'S', 'N', 'A', 'P', '0', '1'});
+        append_le64(head, unit_size);
+        append_le64(head, total_capacity);
+        append_le64(head, holes);
+        for_each_hole([&](size_t position, size_t extent) {
+            append_le64(head, position);
+            append_le64(head, extent);
+        });
+        bitmap.resize(allocation_bits.byteCount());
+        if (!bitmap.empty()) allocation_bits.copyTo(bitmap.data());
+    }
+
+    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0777);
+    if (fd == -1) return -1;
+    iovec parts[2] = {{head.data(), head.size()}, {bitmap.data(), bitmap.size()}};
+    bool written = write_all(fd, parts, 2);
+    close(fd);
+    return written ? 0 : -1;
 }
 
 // Returns a list of available memory regions
 // Format: [count, pos1, size1, pos2, size2, ...]
 void* MemoryManager::getList() {
-    std::vector<std::pair<size_t, size_t>> free_regions;
-    for (const auto& region : memory_regions) {
-        if (region.available) {
-            free_regions.emplace_back(region.position, region.extent);
-        }
-    }
-    
-    std::sort(free_regions.begin(), free_regions.end());
-    
-    // Create array: [count, pos1, size1, pos2, size2, ...]
-    uint16_t* region_array = new uint16_t[free_regions.size() * 2 + 1];
-    region_array[0] = free_regions.size();
-    
-    for (size_t i = 0; i < free_regions.size(); ++i) {
-        region_array[i * 2 + 1] = free_regions[i].first;   // position
-        region_array[i * 2 + 2] = free_regions[i].second;  // extent
-    }
-    
+    auto guard = lock_state();
+    if (concurrent) drain_remote_frees();
+    return build_hole_list<uint16_t>();
+}
+
+// Same as getList() with full-width size_t entries
+size_t* MemoryManager::getList64() {
+    auto guard = lock_state();
+    if (concurrent) drain_remote_frees();
+    return build_hole_list<size_t>();
+}
+
+// Writes [count, pos1, size1, pos2, size2, ...] into list, which holds hole_count() * 2 + 1 entries
+template <typename Word>
+void MemoryManager::pack_hole_list(Word* list) const {
+    size_t next = 1;
+    for_each_hole([&](size_t position, size_t extent) {
+        list[next++] = position;
+        list[next++] = extent;
+    });
+    list[0] = (next - 1) / 2;
+}
+
+// Builds a getList() style array of Word entries; the caller holds the lock if one is needed
+template <typename Word>
+Word* MemoryManager::build_hole_list() const {
+    Word* region_array = new Word[hole_count() * 2 + 1];
+    pack_hole_list(region_array);
     return region_array;
 }
 
@@ -200,40 +1808,36 @@ void* MemoryManager::getList() {
 // 1 = allocated, 0 = free
 // First two bytes contain the size of the bitmap
 void* MemoryManager::getBitmap() {
+    auto guard = lock_state();
+    if (concurrent) drain_remote_frees();
+    return build_bitmap<uint16_t>();
+}
+
+// Same as getBitmap() with an 8-byte length
+uint8_t* MemoryManager::getBitmap64() {
+    auto guard = lock_state();
+    if (concurrent) drain_remote_frees();
+    return build_bitmap<uint64_t>();
+}
+
+// Builds a bitmap whose length header is sizeof(Length) bytes; the caller holds the lock if one is needed
+template <typename Length>
+uint8_t* MemoryManager::build_bitmap() const {
+    const size_t header = sizeof(Length);
     // Calculate required bytes for bitmap
     size_t bytes_needed = total_capacity / 8;
     if(total_capacity % 8 != 0) {
         bytes_needed++; 
     }
-    uint8_t* result = new uint8_t[bytes_needed + 2];
+    uint8_t* result = new uint8_t[bytes_needed + header];
     
     // Store size in little-endian
-    result[0] = static_cast<uint8_t>(bytes_needed & 0xFF);
-    result[1] = static_cast<uint8_t>((bytes_needed >> 8) & 0xFF);
-
-    std::memset(result + 2, 0, bytes_needed);
-    
-    // Track status of each word
-    std::vector<bool> word_status(total_capacity, true);  // Default to allocated
-    
-    // Mark free regions
-    for (const auto& region : memory_regions) {
-        if (region.available) {
-            for (size_t i = 0; i < region.extent; ++i) {
-                word_status[region.position + i] = false;
-            }
-        }
+    for (size_t i = 0; i < header; ++i) {
+        result[i] = static_cast<uint8_t>((static_cast<uint64_t>(bytes_needed) >> (8 * i)) & 0xFF);
     }
-    
-    // Convert to bitmap
-    for (size_t word_idx = 0; word_idx < total_capacity; ++word_idx) {
-        if (word_status[word_idx]) {
-            size_t byte_pos = (word_idx / 8) + 2;
-            uint8_t bit_pos = word_idx % 8;
-            result[byte_pos] |= (1u << bit_pos);
-        }
-    }
-    
+
+    // The live bitmap already has the layout callers expect
+    allocation_bits.copyTo(result + header);
     return result;
 }
 
@@ -246,56 +1850,159 @@ void* MemoryManager::getMemoryStart() {
     return storage_area;
 }
 
+int MemoryManager::getNumaNode() {
+    return numa_node;
+}
+
+// Reads the counters and walks the holes under the lock
+// Blocks parked in per-thread caches count as in use, as the backend sees them
+MemoryManager::Stats MemoryManager::getStats() {
+    auto guard = lock_state();
+    Stats result;
+    result.numaNode = numa_node;
+    result.capacityBytes = total_capacity * unit_size;
+    if (!storage_area) return result;
+
+    size_t free_words = 0;
+    size_t largest = 0;
+    for_each_hole([&](size_t, size_t extent) {
+        result.holeCount++;
+        free_words += extent;
+        largest = std::max(largest, extent);
+    });
+    result.bytesInUse = (total_capacity - free_words) * unit_size;
+    result.largestHole = largest * unit_size;
+    result.externalFragmentation = free_words ? 1.0 - double(largest) / double(free_words) : 0.0;
+#if MEMORY_MANAGER_STATS
+    result.allocations = stats.allocations.load(std::memory_order_relaxed);
+    result.frees = stats.frees.load(std::memory_order_relaxed);
+    result.failedAllocations = stats.failed_allocations.load(std::memory_order_relaxed);
+    result.peakBytesInUse = stats.peak_words * unit_size;
+    for (size_t i = 0; i < Stats::SIZE_CLASS_COUNT; ++i) {
+        result.sizeClasses[i] = stats.size_classes[i].load(std::memory_order_relaxed);
+    }
+#endif
+    return result;
+}
+
+// Recorded only with Options::latencyHistograms; reset by initialize()
+const LatencyHistogram& MemoryManager::getLatency(TimedOperation operation) const {
+    return latency[static_cast<size_t>(operation)];
+}
+
+// Installs a callback for allocate, free and coalesce events; an empty hook removes it
+// Set it while no other thread uses the manager. Coalesce events, and the events of the
+// batch and movable-block calls, fire under the lock in concurrent mode, so the hook must
+// not call back into the manager.
+void MemoryManager::setTraceHook(TraceHook hook) {
+    trace_hook = hook;
+}
+
+// Makes the file of a persistent arena describe it as it is now, so that the next
+// initialize() from the file resumes from here; shutdown() does this too
+// Returns 0, or -1 if the arena is not persistent or the file could not be written
+int MemoryManager::persist() {
+    auto guard = lock_state();
+    if (persistent_fd < 0) return -1;
+    if (concurrent) drain_remote_frees();
+    return write_persistent_state() ? 0 : -1;
+}
+
+bool MemoryManager::wasRestored() {
+    return restored;
+}
+
+// Handles count words, so only word-aligned addresses, such as those of blocks, have one
+size_t MemoryManager::getHandle(void* address) {
+    if (!address || !validate_address(address)) return npos;
+    size_t byte_offset = static_cast<uint8_t*>(address) - storage_area;
+    return (byte_offset % unit_size == 0) ? byte_offset / unit_size : npos;
+}
+
+void* MemoryManager::getAddress(size_t handle) {
+    if (!storage_area || handle >= total_capacity) return nullptr;
+    return storage_area + handle * unit_size;
+}
+
+// Written straight into the mapped header, so it is saved with the rest of the file
+void MemoryManager::setRoot(size_t handle) {
+    if (persistent_fd >= 0) header_of(storage_area)->root = handle;
+}
+
+size_t MemoryManager::getRoot() {
+    return persistent_fd >= 0 ? static_cast<size_t>(header_of(storage_area)->root) : npos;
+}
+
+// Starts appending every allocation and free to a binary log at path, replacing any
+// recording in progress; false if the file cannot be created
+// Like setTraceHook(), call it while no other thread uses the manager
+bool MemoryManager::startRecording(const char* path, size_t ringRecords) {
+    stopRecording();
+    auto started = std::make_unique<AllocationRecorder>(path, unit_size, ringRecords);
+    if (!started->isOpen()) return false;
+    recorder = std::move(started);
+    return true;
+}
+
+// Writes out the records still buffered and closes the log
+void MemoryManager::stopRecording() {
+    recorder.reset();
+}
+
+// Folds another arena's figures into these, as for the arenas of a sharded manager
+// The peak becomes the sum of the peaks, an upper bound on the combined peak;
+// fragmentation is recomputed from the combined free space
+void MemoryManager::Stats::merge(const Stats& other) {
+    size_t free_bytes = (capacityBytes - bytesInUse) + (other.capacityBytes - other.bytesInUse);
+    allocations += other.allocations;
+    frees += other.frees;
+    failedAllocations += other.failedAllocations;
+    bytesInUse += other.bytesInUse;
+    peakBytesInUse += other.peakBytesInUse;
+    capacityBytes += other.capacityBytes;
+    holeCount += other.holeCount;
+    largestHole = std::max(largestHole, other.largestHole);
+    externalFragmentation = free_bytes ? 1.0 - double(largestHole) / double(free_bytes) : 0.0;
+    for (size_t i = 0; i < SIZE_CLASS_COUNT; ++i) sizeClasses[i] += other.sizeClasses[i];
+    if (numaNode != other.numaNode) numaNode = -1;
+}
+
 unsigned MemoryManager::getMemoryLimit() {
     return total_capacity * unit_size;
 }
 
+size_t MemoryManager::getMemoryLimit64() {
+    return total_capacity * unit_size;
+}
+
 // Best Fit allocation strategy
-// Finds the smallest hole that can fit the requested size
+// Finds the smallest hole that can fit the requested size in a single pass
 int bestFit(int sizeInWords, void* list) {
     if (!list) return -1;
     
     uint16_t* hole_data = static_cast<uint16_t*>(list);
     size_t num_holes = hole_data[0];
-    if (num_holes == 0) return -1;
+    size_t word_requirement = static_cast<size_t>(sizeInWords);
 
-    struct HoleInfo {     
-        size_t start;
-        size_t size;
-        size_t waste;     // Tracks unused space
-    };
-    std::vector<HoleInfo> qualified_holes;  
+    int best_pos = -1;
+    size_t least_waste = 0;     // Tracks unused space of the best hole so far
 
-    // Find all holes that can fit the request
     for (size_t i = 0; i < num_holes; i++) {
         size_t position = hole_data[2*i + 1];
         size_t length = hole_data[2*i + 2];
         
-        if (length >= static_cast<size_t>(sizeInWords)) {
-            qualified_holes.push_back({
-                position, 
-                length, 
-                length - static_cast<size_t>(sizeInWords)
-            });
+        // Strictly smaller waste wins, so ties go to the earliest hole
+        if (length >= word_requirement && (best_pos == -1 || length - word_requirement < least_waste)) {
+            best_pos = static_cast<int>(position);
+            least_waste = length - word_requirement;
         }
     }
 
-    if (qualified_holes.empty()) return -1;
-
-    // Find hole with minimum waste
-    auto best_hole = std::min_element(
-        qualified_holes.begin(),
-        qualified_holes.end(),
-        [](const HoleInfo& a, const HoleInfo& b) {
-            return a.waste < b.waste;
-        }
-    );
-
-    return static_cast<int>(best_hole->start);
+    return best_pos;
 }
 
 // Worst Fit allocation strategy
-// Finds the largest hole available
+// Finds the largest hole available in a single pass
 int worstFit(int sizeInWords, void* list) {
     uint16_t* holes = static_cast<uint16_t*>(list);
     if (!holes || holes[0] == 0) return -1;
@@ -323,4 +2030,104 @@ int worstFit(int sizeInWords, void* list) {
     }
     
     return max_pos;
-}
\ No newline at end of file
+}
+
+// Best Fit over a HoleView
+// Smallest hole that fits, lowest position on ties
+size_t bestFit64(size_t sizeInWords, const HoleView& holes) {
+    size_t best = HoleView::npos;
+    size_t best_extent = 0;
+    for (const Hole& hole : holes) {
+        if (hole.extent >= sizeInWords && (best == HoleView::npos || hole.extent < best_extent)) {
+            best = hole.position;
+            best_extent = hole.extent;
+        }
+    }
+    return best;
+}
+
+// Worst Fit over a HoleView
+// Largest hole, provided it fits; lowest position on ties
+size_t worstFit64(size_t sizeInWords, const HoleView& holes) {
+    size_t worst = HoleView::npos;
+    size_t worst_extent = 0;
+    for (const Hole& hole : holes) {
+        if (hole.extent >= sizeInWords && hole.extent > worst_extent) {
+            worst = hole.position;
+            worst_extent = hole.extent;
+        }
+    }
+    return worst;
+}
+
+// First Fit allocation strategy
+// Takes the lowest-addressed hole that fits
+int firstFit(int sizeInWords, void* list) {
+    uint16_t* holes = static_cast<uint16_t*>(list);
+    if (!holes) return -1;
+
+    for (size_t i = 0; i < holes[0]; ++i) {
+        if (holes[2*i + 2] >= static_cast<size_t>(sizeInWords)) return holes[2*i + 1];
+    }
+    return -1;
+}
+
+size_t firstFit64(size_t sizeInWords, const HoleView& holes) {
+    return FreeIndex(nullptr, holes).firstFit(sizeInWords);
+}
+
+// First Fit answered from the allocation bitmap
+// Passed to a MemoryManager, the search scans the live bitmap for the first run of free
+// words instead of visiting holes, which pays off when there are very many of them.
+// Called directly it is plain first fit over the view.
+size_t bitmapFirstFit64(size_t sizeInWords, const HoleView& holes) {
+    return firstFit64(sizeInWords, holes);
+}
+
+// Next Fit over the getList() array; resumes at the first hole at or after cursor
+int NextFit::operator()(int sizeInWords, void* list) {
+    uint16_t* holes = static_cast<uint16_t*>(list);
+    if (!holes || holes[0] == 0) return -1;
+
+    size_t count = holes[0];
+    size_t start = 0;
+    while (start < count && holes[2*start + 1] < cursor) start++;
+
+    for (size_t step = 0; step < count; ++step) {
+        size_t i = (start + step) % count;
+        if (holes[2*i + 2] >= static_cast<size_t>(sizeInWords)) {
+            cursor = holes[2*i + 1];
+            return static_cast<int>(cursor);
+        }
+    }
+    return -1;
+}
+
+size_t NextFit::operator()(size_t sizeInWords, const HoleView& holes) {
+    return FreeIndex(nullptr, holes).nextFit(sizeInWords, cursor);
+}
+
+// Good Fit over the getList() array
+int GoodFit::operator()(int sizeInWords, void* list) const {
+    uint16_t* holes = static_cast<uint16_t*>(list);
+    if (!holes) return -1;
+
+    size_t words = static_cast<size_t>(sizeInWords);
+    size_t limit = words + words * tolerancePercent / 100;
+    int best_pos = -1;
+    size_t best_len = 0;
+    for (size_t i = 0; i < holes[0]; ++i) {
+        size_t length = holes[2*i + 2];
+        if (length < words) continue;
+        if (length <= limit) return holes[2*i + 1];
+        if (best_pos == -1 || length < best_len) {
+            best_pos = holes[2*i + 1];
+            best_len = length;
+        }
+    }
+    return best_pos;
+}
+
+size_t GoodFit::operator()(size_t sizeInWords, const HoleView& holes) const {
+    return FreeIndex(nullptr, holes).goodFit(sizeInWords, tolerancePercent);
+}
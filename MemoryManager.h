@@ -1,48 +1,548 @@
 #ifndef MEMORY_MANAGER_H
 #define MEMORY_MANAGER_H
 
+#include "AllocationBitmap.h"
+#include "AllocationRecorder.h"
+#include "BoundaryTagHeap.h"
+#include "BuddyHeap.h"
+#include "LatencyHistogram.h"
+#include "RemoteFreeList.h"
+#include "ThreadCache.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <functional>
-#include <deque>
-#include <unordered_map>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+// A free hole, in words
+struct Hole {
+    size_t position;
+    size_t extent;
+};
+
+class HoleView;
+class FreeIndex;
+
+// Selector over 64-bit positions: returns the position of the chosen hole, or HoleView::npos
+using HoleSelector = std::function<size_t(size_t, const HoleView&)>;
+
+// (extent, position) of every free hole, smallest first
+using HoleSizeIndex = std::set<std::pair<size_t, size_t>>;
+
+// Build with MEMORY_MANAGER_STATS=0 to compile the statistics counters out of the hot paths
+#ifndef MEMORY_MANAGER_STATS
+#define MEMORY_MANAGER_STATS 1
+#endif
 
 class MemoryManager {
+public:
+    // How the storage area is carved up and tracked
+    enum class Backend {
+        Regions,       // Address-ordered region map plus a size-ordered hole index
+        BoundaryTags,  // Header/footer tags inside storage_area, no out-of-band metadata
+        Buddy,         // Power-of-two blocks with O(log N) split and coalesce
+        Tlsf           // Boundary tags with two-level segregated lists; O(1) best-fit allocate
+    };
+
+    struct Options {
+        Backend backend = Backend::Regions;
+        bool debugChecks = false;  // Validate the tags of every address passed to free()
+        bool concurrent = false;   // Guard all state with an internal lock and cache blocks per thread
+        size_t threadCacheLimit = 32;  // Blocks kept per size class and thread; 0 disables the caches
+        unsigned tlsfSecondLevelBits = 4;  // Tlsf: log2 of the lists per power of two, at most 6
+        bool mappedStorage = false;  // Reserve storage with mmap(MAP_NORESERVE); pages commit on first touch
+        bool hugePages = false;      // Mapped: MAP_HUGETLB if the system has huge pages set aside, else MADV_HUGEPAGE
+        size_t releaseBytes = 0;     // Mapped: give back the pages of free holes of at least this size; 0 never
+        size_t maxSizeInWords = 0;   // Grow on demand up to this many words, reserving the address range
+                                     // up front so blocks never move; implies mappedStorage. 0 fixes the size
+        int numaNode = -1;           // Bind the storage to this NUMA node; implies mappedStorage. -1 leaves it to the kernel
+        bool latencyHistograms = false;  // Time the operations of TimedOperation into getLatency()
+        const char* persistentPath = nullptr;  // Back the arena with this file so it survives restarts; see persist()
+                                     // An existing file must hold an arena, or it is left alone and
+                                     // initialize() fails. The file is the storage, so mappedStorage,
+                                     // hugePages, releaseBytes, maxSizeInWords, numaNode and
+                                     // threadCacheLimit are ignored
+        size_t deferredFrees = 0;    // Regions: frees held for reuse before one batched merge; 0 merges on every free
+    };
+
+    // Operations whose latency can be recorded
+    enum class TimedOperation {
+        Allocate,  // allocate() and allocateAligned(), end to end; an allocateBatch() call is one sample
+        Free,      // free(); a freeBatch() call is one sample
+        Select,    // Choosing a hole on the Regions backend, the selector call included
+        Merge,     // merge_adjacent_regions() on the Regions backend; a batched merge of
+                   // deferred or freeBatch() regions is one sample
+        Count
+    };
+
+    // Events reported to the trace hook, with the address and size in bytes they concern
+    enum class TraceEvent {
+        Allocate,  // Block handed out; the size requested
+        Free,      // Block handed back; the size of the block
+        Coalesce   // Free hole grown by taking in free neighbours; the hole after merging
+    };
+    using TraceHook = std::function<void(TraceEvent event, void* address, size_t bytes)>;
+
+    // Block from allocateMovable(), which compact() may move while it is not pinned
+    // A type of its own, so it cannot be mixed up with the word offsets of getHandle()
+    struct MovableHandle {
+        size_t index = SIZE_MAX;  // Entry of the handle table; SIZE_MAX for no block
+        bool valid() const { return index != SIZE_MAX; }
+    };
+
+    // Snapshot taken by getStats()
+    // The counters and the peak read zero when built with MEMORY_MANAGER_STATS=0; the
+    // figures taken from the holes are always there
+    struct Stats {
+        static constexpr size_t SIZE_CLASS_COUNT = 64;
+
+        size_t allocations = 0;        // Blocks handed out by allocate(), allocateAligned() and allocateBatch()
+        size_t frees = 0;              // Addresses inside the arena passed to free() or freeBatch()
+        size_t failedAllocations = 0;
+        size_t bytesInUse = 0;         // Storage outside the free holes, backend overhead and cached blocks included
+        size_t peakBytesInUse = 0;
+        size_t capacityBytes = 0;      // getMemoryLimit64()
+        size_t holeCount = 0;
+        size_t largestHole = 0;        // In bytes
+        double externalFragmentation = 0;  // 1 - largestHole / free bytes; 0 when nothing is free
+        size_t sizeClasses[SIZE_CLASS_COUNT] = {};  // Allocations of (2^(i-1), 2^i] bytes at index i
+        int numaNode = -1;
+
+        void merge(const Stats& other);
+    };
+
 private:
     struct Region {
-        size_t position;  // Position in words
         size_t extent;    // Size in words
         bool available;
-        Region(size_t p, size_t e, bool a) : position(p), extent(e), available(a) {}
+        bool deferred;    // Freed but not yet merged; still counted as allocated
+        Region(size_t e, bool a) : extent(e), available(a), deferred(false) {}
+    };
+    using RegionMap = std::map<size_t, Region>;  // Keyed by position in words
+    friend class HoleView;
+
+    // Entry of the handle table behind allocateMovable()
+    struct MovableBlock {
+        size_t offset;  // Word offset of the block's address, or npos while the entry is unused
+        size_t bytes;   // Size requested, which is what a move copies
+        unsigned pins;  // Outstanding pin() calls; a pinned block stays where it is
     };
 
+    // Built-in strategies are recognised so allocate() can query hole_index
+    // directly instead of building a getList() array for the selector
+    enum class FitStrategy { Custom, CustomView, BestFit, WorstFit, FirstFit, NextFit, GoodFit, BitmapFirstFit };
+
     unsigned unit_size;
-    std::function<int(int, void*)> selector;
+    std::function<int(int, void*)> selector;  // Legacy selector over the 16-bit getList() array
+    HoleSelector hole_selector;
+    FitStrategy strategy;
+    size_t* fit_cursor;      // NextFit: roving position, held by the selector object
+    unsigned fit_tolerance;  // GoodFit: accepted waste in percent of the request
     uint8_t* storage_area;
-    size_t total_capacity;
-    std::deque<Region> memory_regions;
-    std::unordered_map<uintptr_t, size_t> allocation_table;
+    std::atomic<size_t> total_capacity;  // Words; validate_address() reads it without the lock
+    size_t mapped_bytes;   // Length of the mapping behind storage_area; 0 for heap storage
+    size_t committed_bytes;    // Leading part of the mapping that is accessible
+    size_t reserved_capacity;  // Words the arena may grow to
+    size_t page_bytes;     // Granularity pages are given back at
+    size_t release_bytes;
+    int numa_node;         // Node storage_area is bound to, or -1
+    int persistent_fd;     // File behind a persistent arena, or -1
+    bool persisted_clean;  // The file matches memory; the next change marks it dirty
+    bool restored;         // initialize() mapped back an arena persisted earlier
+    Backend backend;
+    bool debug_checks;
+    RegionMap memory_regions;
+    HoleSizeIndex hole_index;  // (extent, position) of each free region
+    size_t deferred_limit;     // Options::deferredFrees
+    size_t deferred_count;     // Regions waiting in quick_lists
+    std::map<size_t, std::vector<size_t>> quick_lists;  // Positions of deferred regions, by extent
+    std::vector<void*> deferred_addresses;  // Scratch for coalesce_deferred(); reused across calls
+    BoundaryTagHeap tag_heap;
+    BuddyHeap buddy_heap;
+    AllocationBitmap allocation_bits;  // Kept in step with every carve and release
+    std::vector<uint16_t> legacy_list;  // getList() array handed to the legacy selector; reused across calls
 
-    void merge_adjacent_regions();
+    // Concurrent mode
+    bool concurrent;
+    size_t thread_cache_limit;
+    uint64_t instance_id;  // Tells this manager's per-thread caches apart; renewed by initialize()
+    std::mutex state_lock;
+    std::vector<std::shared_ptr<ThreadCache>> thread_caches;
+    std::vector<uint8_t> block_classes;  // Regions and Buddy: cache class of the block starting at each word
+    RemoteFreeList remote_frees;  // Blocks freed while the lock was busy, released by its next holder
+
+    // Statistics; the counters bumped outside the lock are relaxed atomics
+    struct StatCounters {
+        std::atomic<size_t> allocations{0};
+        std::atomic<size_t> frees{0};
+        std::atomic<size_t> failed_allocations{0};
+        std::atomic<size_t> size_classes[Stats::SIZE_CLASS_COUNT] = {};
+        size_t in_use_words = 0;  // Under the lock, kept in step with allocation_bits
+        size_t peak_words = 0;
+    };
+    StatCounters stats;
+    bool timing;  // Options::latencyHistograms
+    LatencyHistogram latency[static_cast<size_t>(TimedOperation::Count)];
+    TraceHook trace_hook;
+    std::unique_ptr<AllocationRecorder> recorder;
+
+    // Movable blocks; all under the lock
+    std::vector<MovableBlock> movable_blocks;  // Indexed by MovableHandle::index
+    std::vector<size_t> free_handles;          // Unused entries of movable_blocks
+    std::map<size_t, size_t> movable_by_offset;  // Entry of each movable block, by word offset
+    size_t compact_cursor;  // Offset compact() resumes from
+
+    void bump(std::atomic<size_t>& counter, size_t amount = 1);
+    void count_allocation(size_t sizeInBytes, bool succeeded);
+    void* finish_allocation(void* result, size_t sizeInBytes, uint64_t started);
+    void mark_allocated(size_t position, size_t extent);
+    void mark_free(size_t position, size_t extent);
+    void reset_stats();
+    uint64_t start_timer() const;
+    void stop_timer(TimedOperation operation, uint64_t started);
+    void settle_hole(size_t position, size_t extent, size_t released);
+    size_t block_words(void* address) const;
+    void acquire_storage(size_t bytes, size_t reservedBytes, const Options& options);
+    bool map_persistent(size_t& sizeInWords, Options& options, std::vector<std::pair<size_t, size_t>>& blocks);
+    void restore_blocks(const std::vector<std::pair<size_t, size_t>>& blocks, const Options& options);
+    bool write_persistent_state();
+    void mark_dirty();
+    bool grow_storage(size_t words);
+    void release_storage();
+    void return_pages(size_t position, size_t extent);
+    RegionMap::iterator merge_adjacent_regions(RegionMap::iterator region);
+    void* reuse_deferred(size_t words);
+    bool coalesce_deferred();
+    size_t find_indexed_hole(size_t words) const;
+    size_t select_custom_hole(size_t words);
+    static FitStrategy classify_selector(const std::function<int(int, void*)>& allocator);
+    static FitStrategy classify_selector(const HoleSelector& allocator);
+    void bind_fit_state();
+    void* allocate_words(size_t words);
+    void* allocate_region(size_t words);
+    void* carve_region(size_t position, size_t words);
+    void* allocate_tagged(size_t words);
+    void* allocate_buddy(size_t words);
+    void* carve_hole(size_t position, size_t words);
+    size_t move_block(size_t offset, const MovableBlock& block);
+    size_t slide_region(size_t offset, const MovableBlock& block);
+    size_t aligned_start(size_t position, size_t payloadOffset, size_t alignment) const;
+    void* allocate_aligned_region(size_t words, size_t alignment);
+    void* allocate_aligned_tagged(size_t words, size_t alignment);
+    void* allocate_aligned_buddy(size_t words, size_t alignment);
+    void release(void* address);
+    void free_region(void* address);
+    void return_region(RegionMap::iterator region);
+    void free_tagged(void* address);
+    void free_buddy(void* address);
+    void free_regions_sorted(void** addresses, size_t count);
+    bool resize_in_place(void* address, size_t words, size_t& old_words);
+    bool resize_region(size_t offset, size_t words, size_t& old_words);
+    bool resize_tagged(void* address, size_t words, size_t& old_words);
+    bool resize_buddy(void* address, size_t words, size_t& old_words);
+    size_t hole_count() const;
+    HoleView hole_view() const;
+    template <typename Word> void pack_hole_list(Word* list) const;
+    template <typename Word> Word* build_hole_list() const;
+    template <typename Word> uint8_t* build_bitmap() const;
+    template <typename Visitor> void for_each_hole(Visitor visit) const;
+    std::unique_lock<std::mutex> lock_state();
+    ThreadCache* local_cache();
+    size_t cache_class_of(void* address) const;
+    void* allocate_concurrent(size_t sizeInBytes);
+    void free_concurrent(void* address);
+    void drain_cache(ThreadCache& cache, size_t size_class, size_t keep);
+    void flush_cache(ThreadCache& cache);
+    void reclaim_orphaned_caches();
+    void drain_remote_frees();
+    bool uses_tags() const;
     bool validate_address(void* addr) const;
     size_t convert_to_words(size_t bytes) const;
 
+protected:
+    // Hooks for BasicMemoryManager's compile-time strategies
+    bool uses_region_index() const;
+    FreeIndex free_index() const;
+    void* allocate_at(size_t position, size_t words, size_t sizeInBytes);
+
 public:
     MemoryManager(unsigned wordSize, std::function<int(int, void*)> allocator);
+    MemoryManager(unsigned wordSize, HoleSelector allocator);
     ~MemoryManager();
 
     void initialize(size_t sizeInWords);
+    void initialize(size_t sizeInWords, const Options& options);
     void shutdown();
+    static constexpr size_t STORAGE_ALIGNMENT = 4096;  // Alignment of getMemoryStart()
+    static constexpr size_t npos = SIZE_MAX;  // Handle of no block
+
     void* allocate(size_t sizeInBytes);
+    void* allocateAligned(size_t sizeInBytes, size_t alignment);
     void free(void* address);
+    void* reallocate(void* address, size_t sizeInBytes);
+    size_t allocateBatch(const size_t* sizes, void** out, size_t count);
+    void freeBatch(void** addresses, size_t count);
     void setAllocator(std::function<int(int, void*)> allocator);
+    void setAllocator(HoleSelector allocator);
     int dumpMemoryMap(char* filename);
-    void* getList();
-    void* getBitmap();
+    int dumpSnapshot(char* filename);  // Binary holes and bitmap; see MemoryManager.cpp for the layout
+    void* getList();      // uint16_t [count, pos1, size1, ...]; values above 65535 are truncated
+    void* getBitmap();    // 2-byte little-endian length, then one bit per word
+    size_t* getList64();  // size_t [count, pos1, size1, ...]
+    uint8_t* getBitmap64();  // 8-byte little-endian length, then one bit per word
     unsigned getWordSize();
     void* getMemoryStart();
     unsigned getMemoryLimit();
+    size_t getMemoryLimit64();
+    int getNumaNode();  // Node the storage is bound to, or -1 if unbound
+    Stats getStats();
+    const LatencyHistogram& getLatency(TimedOperation operation) const;
+    void setTraceHook(TraceHook hook);
+    int persist();
+    bool wasRestored();
+    size_t getHandle(void* address);  // Word offset from getMemoryStart(), stable across restarts; npos if outside or between words
+    void* getAddress(size_t handle);
+    void setRoot(size_t handle);      // Persistent arenas: handle kept in the file for finding the data again
+    size_t getRoot();
+    MovableHandle allocateMovable(size_t sizeInBytes);  // Not valid() when no block can be had
+    void freeMovable(MovableHandle handle);
+    void* pin(MovableHandle handle);  // Current address, fixed until the matching unpin(); nullptr for a bad handle
+    void unpin(MovableHandle handle);
+    size_t compact(size_t budgetBytes);
+    bool startRecording(const char* path, size_t ringRecords = AllocationRecorder::DEFAULT_RING_RECORDS);
+    void stopRecording();
 };
 
 int bestFit(int sizeInWords, void* list);
 int worstFit(int sizeInWords, void* list);
+size_t bestFit64(size_t sizeInWords, const HoleView& holes);
+size_t worstFit64(size_t sizeInWords, const HoleView& holes);
+int firstFit(int sizeInWords, void* list);
+size_t firstFit64(size_t sizeInWords, const HoleView& holes);
+size_t bitmapFirstFit64(size_t sizeInWords, const HoleView& holes);
+
+// Next Fit allocation strategy
+// Like first fit, but each search starts where the previous one stopped and wraps
+// around. The roving position lives in the object, so hand the object itself to the
+// constructor or setAllocator(), wrapped as the selector type wanted:
+// setAllocator(HoleSelector(NextFit())).
+struct NextFit {
+    size_t cursor = 0;
+    int operator()(int sizeInWords, void* list);
+    size_t operator()(size_t sizeInWords, const HoleView& holes);
+};
+
+// Good Fit allocation strategy
+// Takes the first hole, in address order, wasting at most tolerancePercent of the
+// request; falls back to best fit when no hole is that close
+struct GoodFit {
+    unsigned tolerancePercent;
+    explicit GoodFit(unsigned tolerance = 10) : tolerancePercent(tolerance) {}
+    int operator()(int sizeInWords, void* list) const;
+    size_t operator()(size_t sizeInWords, const HoleView& holes) const;
+};
+
+// Non-owning, read-only view of the free holes in address order
+// It iterates the manager's own hole storage in place, so handing one to a
+// selector copies and allocates nothing. Only valid for the duration of the
+// selector call it is passed to.
+class HoleView {
+private:
+    enum class Source { Array, Regions, Blocks, Buddies };
+
+    Source source;
+    const Hole* array;                          // Array: holes[0, count)
+    const MemoryManager::RegionMap* regions;    // Regions: the free entries of a region map
+    const BoundaryTagHeap* blocks;              // Blocks: the free blocks of a boundary-tag heap
+    const BuddyHeap* buddies;                   // Buddies: the free blocks of a buddy heap
+    size_t count;
+
+    friend class MemoryManager;
+    HoleView(const MemoryManager::RegionMap& map, size_t holes)
+        : source(Source::Regions), array(nullptr), regions(&map), blocks(nullptr), buddies(nullptr), count(holes) {}
+    HoleView(const BoundaryTagHeap& heap, size_t holes)
+        : source(Source::Blocks), array(nullptr), regions(nullptr), blocks(&heap), buddies(nullptr), count(holes) {}
+    HoleView(const BuddyHeap& heap, size_t holes)
+        : source(Source::Buddies), array(nullptr), regions(nullptr), blocks(nullptr), buddies(&heap), count(holes) {}
+
+public:
+    static constexpr size_t npos = SIZE_MAX;  // Selector result when no hole fits
+
+    class iterator {
+    private:
+        friend class HoleView;
+        const HoleView* view;
+        MemoryManager::RegionMap::const_iterator region;  // Regions cursor
+        size_t index;   // Array cursor, or start of the current block
+        Hole current;
+
+        // Moves the cursor to the first hole at or after it and loads that hole
+        void settle() {
+            if (view->source == Source::Regions) {
+                while (region != view->regions->end() && !region->second.available) ++region;
+                if (region != view->regions->end()) current = {region->first, region->second.extent};
+            } else if (view->source == Source::Blocks) {
+                size_t limit = view->blocks->capacityWords();
+                while (index < limit && view->blocks->allocatedAt(index)) index += view->blocks->extentAt(index);
+                if (index < limit) current = {index, view->blocks->extentAt(index)};
+            } else if (view->source == Source::Buddies) {
+                size_t limit = view->buddies->capacityWords();
+                while (index < limit && view->buddies->allocatedAt(index)) index += view->buddies->extentAt(index);
+                if (index < limit) current = {index, view->buddies->extentAt(index)};
+            } else if (index < view->count) {
+                current = view->array[index];
+            }
+        }
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Hole;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Hole*;
+        using reference = const Hole&;
+
+        const Hole& operator*() const { return current; }
+        const Hole* operator->() const { return &current; }
+
+        iterator& operator++() {
+            if (view->source == Source::Regions) {
+                ++region;
+            } else if (view->source == Source::Blocks || view->source == Source::Buddies) {
+                index += current.extent;
+            } else {
+                ++index;
+            }
+            settle();
+            return *this;
+        }
+        iterator operator++(int) {
+            iterator previous = *this;
+            ++*this;
+            return previous;
+        }
+
+        bool operator==(const iterator& other) const { return region == other.region && index == other.index; }
+        bool operator!=(const iterator& other) const { return !(*this == other); }
+    };
+
+    HoleView(const Hole* holes, size_t size)
+        : source(Source::Array), array(holes), regions(nullptr), blocks(nullptr), buddies(nullptr), count(size) {}
+
+    iterator begin() const {
+        iterator it;
+        it.view = this;
+        it.region = regions ? regions->begin() : MemoryManager::RegionMap::const_iterator();
+        it.index = 0;
+        it.settle();
+        return it;
+    }
+
+    // First hole starting at or after position
+    iterator lowerBound(size_t position) const {
+        iterator it;
+        it.view = this;
+        it.region = regions ? regions->lower_bound(position) : MemoryManager::RegionMap::const_iterator();
+        it.index = 0;
+        if (source == Source::Array) {
+            it.index = std::lower_bound(array, array + count, position,
+                [](const Hole& hole, size_t value) { return hole.position < value; }) - array;
+        }
+        it.settle();
+        if (source == Source::Blocks || source == Source::Buddies) {
+            while (it != end() && it->position < position) ++it;
+        }
+        return it;
+    }
+
+    iterator end() const {
+        iterator it;
+        it.view = this;
+        it.region = regions ? regions->end() : MemoryManager::RegionMap::const_iterator();
+        it.index = (source == Source::Array) ? count
+                 : (source == Source::Blocks) ? blocks->capacityWords()
+                 : (source == Source::Buddies) ? buddies->capacityWords() : 0;
+        return it;
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+};
+
+// Read-only access to the free holes for fit strategies
+// The size-ordered index is only present for backends that keep one; every
+// search falls back to walking the holes in address order without it.
+class FreeIndex {
+private:
+    const HoleSizeIndex* by_size;
+    HoleView holes;
+
+public:
+    FreeIndex(const HoleSizeIndex* sizeIndex, const HoleView& addressOrder) : by_size(sizeIndex), holes(addressOrder) {}
+
+    const HoleView& byAddress() const { return holes; }
+
+    // Smallest hole that fits, lowest position on ties
+    size_t bestFit(size_t words) const {
+        if (!by_size) return bestFit64(words, holes);
+        auto it = by_size->lower_bound({words, 0});
+        return it == by_size->end() ? HoleView::npos : it->second;
+    }
+
+    // Largest hole, provided it fits; lowest position on ties
+    size_t worstFit(size_t words) const {
+        if (!by_size) return worstFit64(words, holes);
+        if (by_size->empty() || by_size->rbegin()->first < words) return HoleView::npos;
+        return by_size->lower_bound({by_size->rbegin()->first, 0})->second;
+    }
+
+    // Lowest-addressed hole that fits
+    size_t firstFit(size_t words) const {
+        if (by_size && (by_size->empty() || by_size->rbegin()->first < words)) return HoleView::npos;
+        for (const Hole& hole : holes) {
+            if (hole.extent >= words) return hole.position;
+        }
+        return HoleView::npos;
+    }
+
+    // First hole in address order wasting at most tolerancePercent of words, else the best fit
+    // The size index answers "is any hole close enough" up front, so the walk always stops early
+    size_t goodFit(size_t words, unsigned tolerancePercent) const {
+        size_t limit = words + words * tolerancePercent / 100;
+        if (by_size) {
+            auto best = by_size->lower_bound({words, 0});
+            if (best == by_size->end()) return HoleView::npos;
+            if (best->first > limit) return best->second;
+        }
+        size_t best = HoleView::npos;
+        size_t best_extent = 0;
+        for (const Hole& hole : holes) {
+            if (hole.extent < words) continue;
+            if (hole.extent <= limit) return hole.position;
+            if (best == HoleView::npos || hole.extent < best_extent) {
+                best = hole.position;
+                best_extent = hole.extent;
+            }
+        }
+        return best;
+    }
+
+    // First hole that fits at or after cursor, wrapping around; cursor moves to the hole chosen
+    size_t nextFit(size_t words, size_t& cursor) const {
+        if (by_size && (by_size->empty() || by_size->rbegin()->first < words)) return HoleView::npos;
+        for (auto it = holes.lowerBound(cursor); it != holes.end(); ++it) {
+            if (it->extent >= words) return cursor = it->position;
+        }
+        for (const Hole& hole : holes) {
+            if (hole.position >= cursor) break;
+            if (hole.extent >= words) return cursor = hole.position;
+        }
+        return HoleView::npos;
+    }
+};
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,64 @@
+#ifndef NUMA_PLACEMENT_H
+#define NUMA_PLACEMENT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// NUMA placement on top of the raw system calls, so no libnuma is needed
+// Where the kernel has no NUMA support there is one node, 0, and binding fails.
+
+// Nodes the system has online, counted up to the highest node number
+inline size_t numaNodeCount() {
+    size_t count = 1;
+#ifdef __linux__
+    if (FILE* online = std::fopen("/sys/devices/system/node/online", "r")) {
+        // A list of ranges such as "0-1" or "0,2-3"
+        unsigned long first, last;
+        char separator;
+        while (std::fscanf(online, "%lu", &first) == 1) {
+            last = first;
+            if (std::fscanf(online, "%c", &separator) == 1 && separator == '-') {
+                if (std::fscanf(online, "%lu", &last) != 1) break;
+                if (std::fscanf(online, "%c", &separator) != 1) separator = '\n';
+            }
+            if (last + 1 > count) count = last + 1;
+            if (separator != ',') break;
+        }
+        std::fclose(online);
+    }
+#endif
+    return count;
+}
+
+// Node of the core the calling thread is running on, or 0 if unknown
+inline int currentNumaNode() {
+#if defined(__linux__) && defined(SYS_getcpu)
+    unsigned cpu = 0, node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0) return static_cast<int>(node);
+#endif
+    return 0;
+}
+
+// Binds the pages of [address, address + length) to node, before they are first touched
+// address must be page aligned; false if the kernel refused or nodes are not supported
+inline bool bindToNumaNode(void* address, size_t length, int node) {
+#if defined(__linux__) && defined(SYS_mbind)
+    if (node < 0 || node >= 64) return false;
+    constexpr int MPOL_BIND_MODE = 2;  // MPOL_BIND from <numaif.h>
+    uint64_t mask = 1ull << node;
+    // The kernel takes one more than the number of bits in the mask
+    return syscall(SYS_mbind, address, length, MPOL_BIND_MODE, &mask, sizeof(mask) * 8 + 1, 0u) == 0;
+#else
+    (void)address;
+    (void)length;
+    (void)node;
+    return false;
+#endif
+}
+
+#endif
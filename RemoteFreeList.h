@@ -0,0 +1,44 @@
+#ifndef REMOTE_FREE_LIST_H
+#define REMOTE_FREE_LIST_H
+
+#include <atomic>
+#include <cstring>
+
+// Lock-free multi-producer, single-consumer stack of freed blocks
+// Any thread pushes with a single CAS, linking blocks through their first bytes.
+// The consumer, whoever holds the owning heap's lock, takes the whole stack at
+// once with an exchange, so there is no pop race and no ABA problem.
+class RemoteFreeList {
+private:
+    std::atomic<void*> head;
+
+public:
+    RemoteFreeList() : head(nullptr) {}
+
+    void push(void* block) {
+        pushChain(block, block);
+    }
+
+    // Pushes blocks already linked from first to last through their first bytes
+    void pushChain(void* first, void* last) {
+        void* current = head.load(std::memory_order_relaxed);
+        do {
+            std::memcpy(last, &current, sizeof(void*));
+        } while (!head.compare_exchange_weak(current, first, std::memory_order_release,
+                                             std::memory_order_relaxed));
+    }
+
+    // Detaches every pushed block; walk the result with next()
+    void* takeAll() {
+        if (!head.load(std::memory_order_relaxed)) return nullptr;
+        return head.exchange(nullptr, std::memory_order_acquire);
+    }
+
+    static void* next(void* block) {
+        void* following;
+        std::memcpy(&following, block, sizeof(void*));
+        return following;
+    }
+};
+
+#endif
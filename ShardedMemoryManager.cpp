@@ -0,0 +1,141 @@
+#include "ShardedMemoryManager.h"
+#include "NumaPlacement.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+namespace {
+std::atomic<size_t> next_thread_slot{0};
+thread_local size_t thread_slot = next_thread_slot.fetch_add(1, std::memory_order_relaxed);
+}
+
+ShardedMemoryManager::ShardedMemoryManager(unsigned wordSize, HoleSelector allocator, Routing routing)
+    : unit_size(wordSize), hole_selector(allocator), routing(routing) {}
+
+void ShardedMemoryManager::initialize(size_t shardCount, size_t sizeInWordsPerShard) {
+    initialize(shardCount, sizeInWordsPerShard, MemoryManager::Options());
+}
+
+// Creates the shards, each with a storage area of its own
+// Shards whose storage could not be had are dropped, so there may be fewer than asked for
+// With Routing::Node, shard i is bound to node i modulo the number of nodes
+void ShardedMemoryManager::initialize(size_t shardCount, size_t sizeInWordsPerShard,
+                                      const MemoryManager::Options& options) {
+    shutdown();
+    if (shardCount == 0) shardCount = std::max(1u, std::thread::hardware_concurrency());
+
+    MemoryManager::Options shard_options = options;
+    shard_options.concurrent = true;
+    size_t nodes = (routing == Routing::Node) ? numaNodeCount() : 0;
+    node_shards.assign(nodes, {});
+    for (size_t i = 0; i < shardCount; ++i) {
+        if (nodes > 0) shard_options.numaNode = static_cast<int>(i % nodes);
+        auto shard = std::make_unique<MemoryManager>(unit_size, hole_selector);
+        shard->initialize(sizeInWordsPerShard, shard_options);
+        if (!shard->getMemoryStart()) continue;
+        shard_starts.emplace_back(reinterpret_cast<uintptr_t>(shard->getMemoryStart()), shards.size());
+        if (nodes > 0) node_shards[i % nodes].push_back(shards.size());
+        shards.push_back(std::move(shard));
+    }
+    std::sort(shard_starts.begin(), shard_starts.end());
+}
+
+void ShardedMemoryManager::shutdown() {
+    shards.clear();
+    node_shards.clear();
+    shard_starts.clear();
+}
+
+// Shard the calling thread allocates from first
+size_t ShardedMemoryManager::home_shard() const {
+#ifdef __linux__
+    if (routing == Routing::Core) {
+        int cpu = sched_getcpu();
+        if (cpu >= 0) return static_cast<size_t>(cpu) % shards.size();
+    }
+#endif
+    return thread_slot % shards.size();
+}
+
+// Calls allocate(shard) on the home shard, then on the others in turn until one succeeds
+// With Routing::Node the shards of the caller's node come first, starting from the thread's own
+template <typename Allocate>
+void* ShardedMemoryManager::allocate_from_shards(Allocate allocate) {
+    if (shards.empty()) return nullptr;
+    size_t node = (routing == Routing::Node) ? static_cast<size_t>(currentNumaNode()) : 0;
+    if (node < node_shards.size() && !node_shards[node].empty()) {
+        const std::vector<size_t>& local = node_shards[node];
+        for (size_t i = 0; i < local.size(); ++i) {
+            if (void* result = allocate(*shards[local[(thread_slot + i) % local.size()]])) return result;
+        }
+        for (size_t i = 0; i < shards.size(); ++i) {
+            if (std::find(local.begin(), local.end(), i) != local.end()) continue;
+            if (void* result = allocate(*shards[i])) return result;
+        }
+        return nullptr;
+    }
+
+    size_t home = home_shard();
+    for (size_t i = 0; i < shards.size(); ++i) {
+        if (void* result = allocate(*shards[(home + i) % shards.size()])) return result;
+    }
+    return nullptr;
+}
+
+// Allocates from the home shard, stealing from the others in turn when it is full
+void* ShardedMemoryManager::allocate(size_t sizeInBytes) {
+    return allocate_from_shards([&](MemoryManager& shard) { return shard.allocate(sizeInBytes); });
+}
+
+void* ShardedMemoryManager::allocateAligned(size_t sizeInBytes, size_t alignment) {
+    return allocate_from_shards([&](MemoryManager& shard) { return shard.allocateAligned(sizeInBytes, alignment); });
+}
+
+// The shard with the last storage area starting at or below address
+// That shard's own free() checks that address lies inside its area
+size_t ShardedMemoryManager::ownerOf(void* address) const {
+    uintptr_t key = reinterpret_cast<uintptr_t>(address);
+    auto next = std::upper_bound(shard_starts.begin(), shard_starts.end(), std::make_pair(key, npos));
+    if (next == shard_starts.begin()) return npos;
+    size_t shard = std::prev(next)->second;
+    uintptr_t start = std::prev(next)->first;
+    return key - start < shards[shard]->getMemoryLimit64() ? shard : npos;
+}
+
+// Hands address back to the shard it came from; addresses no shard owns are ignored
+void ShardedMemoryManager::free(void* address) {
+    if (!address) return;
+    size_t shard = ownerOf(address);
+    if (shard != npos) shards[shard]->free(address);
+}
+
+MemoryManager::Stats ShardedMemoryManager::getStats() {
+    MemoryManager::Stats total;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        if (i == 0) {
+            total = shards[i]->getStats();
+        } else {
+            total.merge(shards[i]->getStats());
+        }
+    }
+    return total;
+}
+
+// Per-node usage; the result's numaNode is -1 when no shard is bound to node
+MemoryManager::Stats ShardedMemoryManager::getNodeStats(int node) {
+    MemoryManager::Stats total;
+    bool first = true;
+    for (auto& shard : shards) {
+        if (shard->getNumaNode() != node) continue;
+        if (first) {
+            total = shard->getStats();
+            first = false;
+        } else {
+            total.merge(shard->getStats());
+        }
+    }
+    return total;
+}
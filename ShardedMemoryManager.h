@@ -0,0 +1,62 @@
+#ifndef SHARDED_MEMORY_MANAGER_H
+#define SHARDED_MEMORY_MANAGER_H
+
+#include "MemoryManager.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Facade over several independent MemoryManager shards
+// allocate() goes to the calling thread's shard, or the shard of the core it runs on,
+// so threads on different shards never meet on a lock; when that shard is out of space
+// the others are tried in turn. free() finds the owning shard from the address, by
+// binary search over the shards' storage areas, so any thread may free any block.
+// Every shard runs in concurrent mode, as several threads may still share one.
+// With Routing::Node each shard's storage is bound to a NUMA node, and a thread steals from
+// the shards of its own node before going to remote ones.
+class ShardedMemoryManager {
+public:
+    // How the calling thread is mapped to its shard
+    enum class Routing {
+        Thread,  // Threads are dealt out to shards round robin, on their first allocation
+        Core,    // The core the thread is running on, where sched_getcpu() is available
+        Node     // Shards are bound to NUMA nodes in turn; threads use the shards of their own node
+    };
+
+    static constexpr size_t npos = SIZE_MAX;
+
+private:
+    unsigned unit_size;
+    HoleSelector hole_selector;
+    Routing routing;
+    std::vector<std::unique_ptr<MemoryManager>> shards;
+    std::vector<std::vector<size_t>> node_shards;  // Routing::Node: shards bound to each node
+    std::vector<std::pair<uintptr_t, size_t>> shard_starts;  // (storage start, shard), ordered by start
+
+    size_t home_shard() const;
+    template <typename Allocate>
+    void* allocate_from_shards(Allocate allocate);
+
+public:
+    ShardedMemoryManager(unsigned wordSize, HoleSelector allocator, Routing routing = Routing::Thread);
+
+    ShardedMemoryManager(const ShardedMemoryManager&) = delete;
+    ShardedMemoryManager& operator=(const ShardedMemoryManager&) = delete;
+
+    // shardCount: 0 for one shard per hardware thread
+    void initialize(size_t shardCount, size_t sizeInWordsPerShard);
+    void initialize(size_t shardCount, size_t sizeInWordsPerShard, const MemoryManager::Options& options);
+    void shutdown();
+
+    void* allocate(size_t sizeInBytes);
+    void* allocateAligned(size_t sizeInBytes, size_t alignment);
+    void free(void* address);
+    size_t ownerOf(void* address) const;  // Index of the shard holding address, or npos
+    MemoryManager::Stats getStats();  // All shards together
+    MemoryManager::Stats getNodeStats(int node);  // The shards bound to node
+    size_t getShardCount() const { return shards.size(); }
+    MemoryManager& getShard(size_t index) { return *shards[index]; }
+};
+
+#endif
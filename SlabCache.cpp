@@ -0,0 +1,131 @@
+#include "SlabCache.h"
+#include <cstring>
+
+// Sets up the size classes; no memory is taken from the parent until the first allocation
+SlabCache::SlabCache(MemoryManager& manager, size_t slabBytes, bool returnEmptySlabs)
+    : parent(manager), slab_bytes(slabBytes < MAX_OBJECT_SIZE ? MAX_OBJECT_SIZE : slabBytes),
+      return_empty_slabs(returnEmptySlabs) {
+    for (size_t i = 0; i < CLASS_COUNT; ++i) {
+        classes[i].object_size = MIN_OBJECT_SIZE << i;
+        classes[i].objects_per_slab = slab_bytes / classes[i].object_size;
+        classes[i].partial = nullptr;
+        classes[i].empty_slabs = 0;
+    }
+}
+
+// Hands every slab back to the parent
+SlabCache::~SlabCache() {
+    for (auto& slab : slabs) {
+        parent.free(slab.second.start);
+    }
+}
+
+// Index of the smallest size class holding sizeInBytes
+size_t SlabCache::class_of(size_t sizeInBytes) {
+    if (sizeInBytes <= MIN_OBJECT_SIZE) return 0;
+    return (64 - __builtin_clzll(sizeInBytes - 1)) - 4;  // ceil(log2(size)) - log2(MIN_OBJECT_SIZE)
+}
+
+void SlabCache::push_partial(Slab* slab) {
+    SizeClass& size_class = classes[slab->size_class];
+    slab->prev_partial = nullptr;
+    slab->next_partial = size_class.partial;
+    if (size_class.partial) size_class.partial->prev_partial = slab;
+    size_class.partial = slab;
+}
+
+void SlabCache::remove_partial(Slab* slab) {
+    if (slab->prev_partial) {
+        slab->prev_partial->next_partial = slab->next_partial;
+    } else {
+        classes[slab->size_class].partial = slab->next_partial;
+    }
+    if (slab->next_partial) slab->next_partial->prev_partial = slab->prev_partial;
+}
+
+// Takes a new slab from the parent for the given size class
+SlabCache::Slab* SlabCache::grow(size_t size_class) {
+    uint8_t* start = static_cast<uint8_t*>(parent.allocate(slab_bytes));
+    if (!start) return nullptr;
+
+    Slab& slab = slabs[reinterpret_cast<uintptr_t>(start)];
+    slab.start = start;
+    slab.size_class = size_class;
+    slab.in_use = 0;
+    slab.untouched = classes[size_class].objects_per_slab;
+    slab.free_objects = nullptr;
+    push_partial(&slab);
+    classes[size_class].empty_slabs++;
+    return &slab;
+}
+
+// Returns an empty slab to the parent
+void SlabCache::release_slab(std::map<uintptr_t, Slab>::iterator slab_it) {
+    Slab& slab = slab_it->second;
+    remove_partial(&slab);
+    classes[slab.size_class].empty_slabs--;
+    parent.free(slab.start);
+    slabs.erase(slab_it);
+}
+
+// Allocates an object from the matching size class
+// Sizes above MAX_OBJECT_SIZE go straight to the parent
+void* SlabCache::allocate(size_t sizeInBytes) {
+    if (sizeInBytes == 0) return nullptr;
+    if (sizeInBytes > MAX_OBJECT_SIZE) return parent.allocate(sizeInBytes);
+
+    size_t index = class_of(sizeInBytes);
+    SizeClass& size_class = classes[index];
+    Slab* slab = size_class.partial;
+    if (!slab && !(slab = grow(index))) return nullptr;
+
+    void* object;
+    if (slab->free_objects) {
+        object = slab->free_objects;
+        std::memcpy(&slab->free_objects, object, sizeof(void*));  // Pop the next link
+    } else {
+        object = slab->start + (--slab->untouched) * size_class.object_size;
+    }
+
+    if (slab->in_use++ == 0) size_class.empty_slabs--;
+    if (slab->in_use == size_class.objects_per_slab) remove_partial(slab);
+    return object;
+}
+
+// Returns an object to its slab, or passes addresses the cache did not hand out to the parent
+void SlabCache::free(void* address) {
+    if (!address) return;
+
+    uintptr_t key = reinterpret_cast<uintptr_t>(address);
+    auto slab_it = slabs.upper_bound(key);
+    if (slab_it == slabs.begin() || key - std::prev(slab_it)->first >= slab_bytes) {
+        parent.free(address);
+        return;
+    }
+    --slab_it;
+
+    Slab& slab = slab_it->second;
+    SizeClass& size_class = classes[slab.size_class];
+    if (slab.in_use == size_class.objects_per_slab) push_partial(&slab);
+
+    std::memcpy(address, &slab.free_objects, sizeof(void*));  // Push onto the free list
+    slab.free_objects = address;
+
+    if (--slab.in_use == 0) {
+        size_class.empty_slabs++;
+        // Keep one empty slab per class so alternating allocate/free does not thrash the parent
+        if (return_empty_slabs && size_class.empty_slabs > 1) release_slab(slab_it);
+    }
+}
+
+// Gives every empty slab back to the parent
+void SlabCache::trim() {
+    for (auto slab_it = slabs.begin(); slab_it != slabs.end();) {
+        auto current = slab_it++;
+        if (current->second.in_use == 0) release_slab(current);
+    }
+}
+
+size_t SlabCache::getSlabCount() const {
+    return slabs.size();
+}
@@ -0,0 +1,70 @@
+#ifndef SLAB_CACHE_H
+#define SLAB_CACHE_H
+
+#include "MemoryManager.h"
+#include <cstddef>
+#include <cstdint>
+#include <map>
+
+// Small-object allocator layered on a MemoryManager
+// Requests of up to MAX_OBJECT_SIZE bytes are rounded up to a power-of-two size
+// class and served from slabs: large chunks taken from the parent with a single
+// allocate() and cut into equal objects. Each slab threads its free objects
+// through a singly-linked list stored in the objects themselves, so allocate
+// and free are O(1) apart from the slab lookup on free. Larger requests are
+// passed straight to the parent.
+// The cache must be destroyed before its parent is shut down or reinitialized.
+class SlabCache {
+public:
+    static constexpr size_t MIN_OBJECT_SIZE = 16;
+    static constexpr size_t MAX_OBJECT_SIZE = 256;
+
+private:
+    static constexpr size_t CLASS_COUNT = 5;  // 16, 32, 64, 128, 256
+
+    struct Slab {
+        uint8_t* start;
+        size_t size_class;
+        size_t in_use;          // Objects currently handed out
+        size_t untouched;       // Objects never handed out, taken from the end of the slab
+        void* free_objects;     // Freed objects, linked through their first bytes
+        Slab* prev_partial;     // Neighbours in the size class list of slabs with spare objects
+        Slab* next_partial;
+    };
+
+    struct SizeClass {
+        size_t object_size;
+        size_t objects_per_slab;
+        Slab* partial;          // Slabs with at least one free object
+        size_t empty_slabs;     // Slabs with no objects in use, kept for reuse
+    };
+
+    MemoryManager& parent;
+    size_t slab_bytes;
+    bool return_empty_slabs;
+    SizeClass classes[CLASS_COUNT];
+    std::map<uintptr_t, Slab> slabs;  // Keyed by slab start address
+
+    static size_t class_of(size_t sizeInBytes);
+    Slab* grow(size_t size_class);
+    void release_slab(std::map<uintptr_t, Slab>::iterator slab_it);
+    void push_partial(Slab* slab);
+    void remove_partial(Slab* slab);
+
+public:
+    // slabBytes: bytes requested from the parent for each slab
+    // returnEmptySlabs: hand a slab back to the parent as soon as it empties,
+    // keeping at most one empty slab per size class
+    SlabCache(MemoryManager& manager, size_t slabBytes = 16384, bool returnEmptySlabs = true);
+    ~SlabCache();
+
+    SlabCache(const SlabCache&) = delete;
+    SlabCache& operator=(const SlabCache&) = delete;
+
+    void* allocate(size_t sizeInBytes);
+    void free(void* address);
+    void trim();  // Returns every empty slab to the parent
+    size_t getSlabCount() const;
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef THREAD_CACHE_H
+#define THREAD_CACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+
+// Per-thread stash of free blocks used by MemoryManager's concurrent mode
+// Blocks are grouped by class, their size in words, and linked through their
+// first bytes, so pushing and popping never touches shared state.
+// Only the owning thread uses a cache until it sets orphaned on exit; after
+// that the manager may drain it under its lock.
+class ThreadCache {
+public:
+    static constexpr size_t MAX_BLOCK_WORDS = 64;  // Largest class kept per thread
+
+private:
+    void* heads[MAX_BLOCK_WORDS + 1];
+    size_t counts[MAX_BLOCK_WORDS + 1];
+
+public:
+    std::atomic<bool> orphaned;  // Owning thread has exited
+    std::atomic<bool> retired;   // Manager has shut down and dropped the cache
+
+    ThreadCache() : orphaned(false), retired(false) {
+        for (size_t i = 0; i <= MAX_BLOCK_WORDS; ++i) {
+            heads[i] = nullptr;
+            counts[i] = 0;
+        }
+    }
+
+    void push(size_t size_class, void* block) {
+        std::memcpy(block, &heads[size_class], sizeof(void*));
+        heads[size_class] = block;
+        counts[size_class]++;
+    }
+
+    void* pop(size_t size_class) {
+        void* block = heads[size_class];
+        if (!block) return nullptr;
+        std::memcpy(&heads[size_class], block, sizeof(void*));
+        counts[size_class]--;
+        return block;
+    }
+
+    size_t count(size_t size_class) const {
+        return counts[size_class];
+    }
+};
+
+#endif
@@ -0,0 +1,153 @@
+// Microbenchmarks for MemoryManager
+// Each benchmark runs over a range of arena sizes and fragmentation levels; a
+// fragmentation level of f leaves f percent of a carpet of small blocks freed, with
+// the free ones spread evenly between the live ones, before the timed loop starts.
+
+#include "MemoryManager.h"
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace {
+
+constexpr unsigned WORD_SIZE = 8;
+constexpr size_t CARPET_BLOCK = 64;  // Bytes per block of the fragmenting carpet
+
+enum Strategy { BEST_FIT, WORST_FIT, FIRST_FIT, NEXT_FIT, GOOD_FIT, BITMAP_FIRST_FIT };
+
+HoleSelector selector_for(int64_t strategy) {
+    switch (strategy) {
+        case WORST_FIT: return worstFit64;
+        case FIRST_FIT: return firstFit64;
+        case NEXT_FIT: return HoleSelector(NextFit());
+        case GOOD_FIT: return HoleSelector(GoodFit());
+        case BITMAP_FIRST_FIT: return bitmapFirstFit64;
+        default: return bestFit64;
+    }
+}
+
+const char* strategy_name(int64_t strategy) {
+    static const char* names[] = {"bestFit", "worstFit", "firstFit", "nextFit", "goodFit", "bitmapFirstFit"};
+    return names[strategy];
+}
+
+// Fills half the arena with carpet blocks and frees fragmentPercent of them
+std::unique_ptr<MemoryManager> fragmented_arena(int64_t strategy, size_t words, int64_t fragmentPercent) {
+    auto manager = std::make_unique<MemoryManager>(WORD_SIZE, selector_for(strategy));
+    manager->initialize(words);
+    std::vector<void*> carpet;
+    for (size_t used = 0; used < words * WORD_SIZE / 2; used += CARPET_BLOCK) {
+        void* block = manager->allocate(CARPET_BLOCK);
+        if (!block) break;
+        carpet.push_back(block);
+    }
+    size_t freed = 0;
+    for (size_t i = 0; i < carpet.size(); ++i) {
+        // Free block i when doing so keeps the freed share at or below fragmentPercent
+        if ((freed + 1) * 100 <= static_cast<size_t>(fragmentPercent) * (i + 1)) {
+            manager->free(carpet[i]);
+            freed++;
+        }
+    }
+    return manager;
+}
+
+// Arguments: strategy, arena words, fragmentation percent
+void arena_arguments(benchmark::internal::Benchmark* benchmark) {
+    for (int64_t strategy = BEST_FIT; strategy <= BITMAP_FIRST_FIT; ++strategy) {
+        for (int64_t words : {int64_t(1) << 12, int64_t(1) << 16, int64_t(1) << 20}) {
+            for (int64_t fragment : {0, 50, 90}) benchmark->Args({strategy, words, fragment});
+        }
+    }
+}
+
+void view_arguments(benchmark::internal::Benchmark* benchmark) {
+    for (int64_t words : {int64_t(1) << 12, int64_t(1) << 16, int64_t(1) << 20}) {
+        for (int64_t fragment : {0, 50, 90}) benchmark->Args({BEST_FIT, words, fragment});
+    }
+}
+
+// One allocate and one free of a random small size per iteration
+void BM_AllocateFree(benchmark::State& state) {
+    auto manager = fragmented_arena(state.range(0), state.range(1), state.range(2));
+    std::mt19937 random(1);
+    std::vector<size_t> sizes(1024);
+    for (auto& size : sizes) size = 8 + random() % 512;
+
+    size_t next = 0;
+    for (auto _ : state) {
+        void* block = manager->allocate(sizes[next++ % sizes.size()]);
+        benchmark::DoNotOptimize(block);
+        manager->free(block);
+    }
+    state.SetLabel(strategy_name(state.range(0)));
+}
+BENCHMARK(BM_AllocateFree)->Apply(arena_arguments);
+
+// Allocates blocks until the batch is full, then frees them in random order
+void BM_AllocateBurst(benchmark::State& state) {
+    auto manager = fragmented_arena(state.range(0), state.range(1), state.range(2));
+    std::mt19937 random(2);
+    std::vector<void*> blocks(64);
+    std::vector<size_t> order(blocks.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+
+    for (auto _ : state) {
+        for (auto& block : blocks) block = manager->allocate(8 + random() % 256);
+        std::shuffle(order.begin(), order.end(), random);
+        for (size_t i : order) manager->free(blocks[i]);
+    }
+    state.SetItemsProcessed(state.iterations() * blocks.size());
+    state.SetLabel(strategy_name(state.range(0)));
+}
+BENCHMARK(BM_AllocateBurst)->Apply(arena_arguments);
+
+void BM_Malloc(benchmark::State& state) {
+    std::mt19937 random(1);
+    std::vector<size_t> sizes(1024);
+    for (auto& size : sizes) size = 8 + random() % 512;
+
+    size_t next = 0;
+    for (auto _ : state) {
+        void* block = std::malloc(sizes[next++ % sizes.size()]);
+        benchmark::DoNotOptimize(block);
+        std::free(block);
+    }
+}
+BENCHMARK(BM_Malloc);
+
+void BM_GetList(benchmark::State& state) {
+    auto manager = fragmented_arena(state.range(0), state.range(1), state.range(2));
+    for (auto _ : state) {
+        size_t* list = manager->getList64();
+        benchmark::DoNotOptimize(list);
+        delete[] list;
+    }
+}
+BENCHMARK(BM_GetList)->Apply(view_arguments);
+
+void BM_GetBitmap(benchmark::State& state) {
+    auto manager = fragmented_arena(state.range(0), state.range(1), state.range(2));
+    for (auto _ : state) {
+        uint8_t* bitmap = manager->getBitmap64();
+        benchmark::DoNotOptimize(bitmap);
+        delete[] bitmap;
+    }
+}
+BENCHMARK(BM_GetBitmap)->Apply(view_arguments);
+
+void BM_DumpMemoryMap(benchmark::State& state) {
+    auto manager = fragmented_arena(state.range(0), state.range(1), state.range(2));
+    char target[] = "/dev/null";
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(manager->dumpMemoryMap(target));
+    }
+}
+BENCHMARK(BM_DumpMemoryMap)->Apply(view_arguments);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,249 @@
+// Replays a recorded allocation log against every strategy and against malloc
+// Reports throughput, p50/p99 latency of allocate and free, failed allocations and
+// external fragmentation sampled over the run.
+//
+// The log is either a binary log written by MemoryManager::startRecording(), or
+// text, one operation per line; # starts a comment:
+//   a <id> <bytes>   allocate bytes and call the block id
+//   f <id>           free the block called id
+// Ids may be reused once their block is freed. Binary logs name blocks by offset,
+// and give the word size the replay uses unless --word-size says otherwise.
+//
+// usage: trace_replay [--word-size N] [--arena-words N] [--samples N] <log>
+//        trace_replay --generate <operations> [seed] > log
+
+#include "AllocationRecorder.h"
+#include "LatencyHistogram.h"
+#include "MemoryManager.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+struct Operation {
+    bool allocate;
+    size_t slot;   // Dense index standing for the log's id
+    size_t bytes;
+};
+
+struct Trace {
+    std::vector<Operation> operations;
+    size_t slots = 0;
+    size_t peak_live_bytes = 0;
+};
+
+// Builds a trace from operations on named blocks, renumbering the names densely
+class TraceBuilder {
+private:
+    Trace& trace;
+    std::unordered_map<unsigned long long, size_t> slot_of;
+    std::vector<size_t> live_bytes;
+    size_t live = 0;
+
+public:
+    explicit TraceBuilder(Trace& target) : trace(target) {}
+    ~TraceBuilder() { trace.slots = slot_of.size(); }
+
+    void allocate(unsigned long long id, size_t bytes) {
+        auto slot = slot_of.emplace(id, slot_of.size()).first->second;
+        if (slot >= live_bytes.size()) live_bytes.resize(slot + 1, 0);
+        live += bytes - live_bytes[slot];
+        live_bytes[slot] = bytes;
+        trace.operations.push_back({true, slot, bytes});
+        trace.peak_live_bytes = std::max(trace.peak_live_bytes, live);
+    }
+
+    void free(unsigned long long id) {
+        auto found = slot_of.find(id);
+        if (found == slot_of.end()) return;
+        live -= live_bytes[found->second];
+        live_bytes[found->second] = 0;
+        trace.operations.push_back({false, found->second, 0});
+    }
+};
+
+// Reads a text or binary log; false if the file cannot be read
+bool load_trace(const char* path, Trace& trace, unsigned& wordSize, bool keepWordSize) {
+    std::vector<AllocationRecorder::Record> records;
+    unsigned recorded_word_size = 0;
+    if (AllocationRecorder::read(path, records, &recorded_word_size) || !records.empty()) {
+        if (!keepWordSize && recorded_word_size > 0) wordSize = recorded_word_size;
+        TraceBuilder builder(trace);
+        for (const auto& record : records) {
+            if (record.free) {
+                builder.free(record.offset);
+            } else {
+                builder.allocate(record.offset, record.bytes);
+            }
+        }
+        return true;
+    }
+
+    FILE* log = std::fopen(path, "r");
+    if (!log) return false;
+    TraceBuilder builder(trace);
+    char line[256];
+    unsigned long long id, bytes;
+    while (std::fgets(line, sizeof(line), log)) {
+        if (std::sscanf(line, "a %llu %llu", &id, &bytes) == 2) {
+            builder.allocate(id, static_cast<size_t>(bytes));
+        } else if (std::sscanf(line, "f %llu", &id) == 1) {
+            builder.free(id);
+        }
+    }
+    std::fclose(log);
+    return true;
+}
+
+// Writes a log of mixed small and occasional large blocks with a drifting live set
+void generate_trace(size_t operations, unsigned seed) {
+    std::mt19937_64 random(seed);
+    std::vector<unsigned long long> live;
+    unsigned long long next_id = 0;
+    std::printf("# synthetic trace, seed %u\n", seed);
+    for (size_t i = 0; i < operations; ++i) {
+        bool grow = live.empty() || random() % 100 < 52;
+        if (grow) {
+            size_t bytes = (random() % 16 == 0) ? 1024 + random() % 16384 : 8 + random() % 248;
+            std::printf("a %llu %zu\n", next_id, bytes);
+            live.push_back(next_id++);
+        } else {
+            size_t victim = random() % live.size();
+            std::printf("f %llu\n", live[victim]);
+            live[victim] = live.back();
+            live.pop_back();
+        }
+    }
+}
+
+struct Result {
+    LatencyHistogram allocate_latency;
+    LatencyHistogram free_latency;
+    uint64_t ticks = 0;
+    size_t failed = 0;
+    std::vector<double> fragmentation;
+};
+
+// Runs the trace through allocate and release, sampling fragmentation samples times when
+// sample is given; the sampling is not timed
+template <typename Allocate, typename Release, typename Sample>
+void replay(const Trace& trace, size_t samples, Allocate allocate, Release release, Sample sample, Result& result) {
+    std::vector<void*> blocks(trace.slots, nullptr);
+    size_t interval = std::max<size_t>(1, trace.operations.size() / std::max<size_t>(1, samples));
+    for (size_t i = 0; i < trace.operations.size(); ++i) {
+        const Operation& operation = trace.operations[i];
+        uint64_t started = LatencyHistogram::now();
+        if (operation.allocate) {
+            void* block = allocate(operation.bytes);
+            uint64_t took = LatencyHistogram::now() - started;
+            result.allocate_latency.record(took);
+            result.ticks += took;
+            if (!block) result.failed++;
+            blocks[operation.slot] = block;
+        } else {
+            release(blocks[operation.slot]);
+            uint64_t took = LatencyHistogram::now() - started;
+            result.free_latency.record(took);
+            result.ticks += took;
+            blocks[operation.slot] = nullptr;
+        }
+        if ((i + 1) % interval == 0) sample(result);
+    }
+    for (void* block : blocks) {
+        if (block) release(block);
+    }
+}
+
+void report(const char* name, const Trace& trace, const Result& result) {
+    double tick_ns = LatencyHistogram::nanosecondsPerTick();
+    double seconds = result.ticks * tick_ns * 1e-9;
+    std::printf("%-15s %9.2f Mops/s  alloc p50 %6.0f ns p99 %7.0f ns  free p50 %6.0f ns p99 %7.0f ns  failed %zu",
+                name, seconds > 0 ? trace.operations.size() / seconds * 1e-6 : 0.0,
+                result.allocate_latency.percentile(0.5) * tick_ns, result.allocate_latency.percentile(0.99) * tick_ns,
+                result.free_latency.percentile(0.5) * tick_ns, result.free_latency.percentile(0.99) * tick_ns,
+                result.failed);
+    if (!result.fragmentation.empty()) {
+        std::printf("\n%15s fragmentation:", "");
+        for (double value : result.fragmentation) std::printf(" %.2f", value);
+    }
+    std::printf("\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    unsigned word_size = 8;
+    bool word_size_given = false;
+    size_t arena_words = 0;
+    size_t samples = 10;
+    const char* path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "--generate") && i + 1 < argc) {
+            generate_trace(std::strtoull(argv[i + 1], nullptr, 10), i + 2 < argc ? std::atoi(argv[i + 2]) : 1);
+            return 0;
+        }
+        if (!std::strcmp(argv[i], "--word-size") && i + 1 < argc) {
+            word_size = std::atoi(argv[++i]);
+            word_size_given = true;
+        } else if (!std::strcmp(argv[i], "--arena-words") && i + 1 < argc) {
+            arena_words = std::strtoull(argv[++i], nullptr, 10);
+        } else if (!std::strcmp(argv[i], "--samples") && i + 1 < argc) {
+            samples = std::strtoull(argv[++i], nullptr, 10);
+        } else {
+            path = argv[i];
+        }
+    }
+    if (!path || word_size == 0) {
+        std::fprintf(stderr, "usage: %s [--word-size N] [--arena-words N] [--samples N] <log>\n"
+                             "       %s --generate <operations> [seed]\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    Trace trace;
+    if (!load_trace(path, trace, word_size, word_size_given)) {
+        std::fprintf(stderr, "cannot read %s\n", path);
+        return 1;
+    }
+    // Twice the peak live set leaves room for the fragmentation the strategies differ on
+    if (arena_words == 0) arena_words = std::max<size_t>(1024, 2 * trace.peak_live_bytes / word_size);
+    std::printf("%zu operations, peak live %zu bytes, arena %zu words of %u bytes\n",
+                trace.operations.size(), trace.peak_live_bytes, arena_words, word_size);
+
+    struct Candidate {
+        const char* name;
+        HoleSelector selector;
+    };
+    Candidate candidates[] = {
+        {"bestFit", bestFit64},
+        {"worstFit", worstFit64},
+        {"firstFit", firstFit64},
+        {"nextFit", HoleSelector(NextFit())},
+        {"goodFit", HoleSelector(GoodFit())},
+        {"bitmapFirstFit", bitmapFirstFit64},
+    };
+    for (auto& candidate : candidates) {
+        MemoryManager manager(word_size, candidate.selector);
+        manager.initialize(arena_words);
+        Result result;
+        replay(trace, samples,
+               [&](size_t bytes) { return manager.allocate(bytes); },
+               [&](void* block) { manager.free(block); },
+               [&](Result& r) { r.fragmentation.push_back(manager.getStats().externalFragmentation); },
+               result);
+        report(candidate.name, trace, result);
+    }
+
+    Result result;
+    replay(trace, samples,
+           [](size_t bytes) { return std::malloc(bytes); },
+           [](void* block) { std::free(block); },
+           [](Result&) {},
+           result);
+    report("malloc", trace, result);
+    return 0;
+}